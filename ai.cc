@@ -0,0 +1,642 @@
+#include <cfloat>
+#include <cstdint>
+#include <cstring>
+
+#include "tetris.h"
+#include "batch.h"
+#include "ai.h"
+
+const Ai_Weights AI_DEFAULT_WEIGHTS = {
+    -0.510066f,
+    0.760666f,
+    -0.35663f,
+    -0.184483f
+};
+
+const Ai_Config AI_DEFAULT_CONFIG = {
+    ai_weighted_heuristic,
+    &AI_DEFAULT_WEIGHTS
+};
+
+const Ai_Table_Config AI_DEFAULT_TABLE_CONFIG = {
+    1 << 20,
+    AI_TABLE_REPLACE_OLDEST
+};
+
+static int32_t count_bits(uint32_t value)
+{
+    value = value - ((value >> 1) & 0x55555555u);
+    value = (value & 0x33333333u) + ((value >> 2) & 0x33333333u);
+    return (int32_t)((((value + (value >> 4)) & 0x0F0F0F0Fu) *
+                      0x01010101u) >> 24);
+}
+
+void ai_compute_features(const uint16_t *bitboard, int32_t lines,
+                         Ai_Features *features)
+{
+    int32_t heights[WIDTH] = {};
+    uint32_t seen = 0;
+
+    *features = {};
+    features->lines = lines;
+
+    for (int32_t row = 0; row < HEIGHT; ++row)
+    {
+        uint32_t cells = bitboard[row];
+        uint32_t tops = cells & ~seen;
+        while (tops)
+        {
+            int32_t col = count_bits((tops & (0u - tops)) - 1);
+            heights[col] = HEIGHT - row;
+            tops &= tops - 1;
+        }
+        features->holes += count_bits(seen & ~cells);
+        seen |= cells;
+    }
+
+    for (int32_t col = 0; col < WIDTH; ++col)
+    {
+        features->aggregate_height += heights[col];
+        if (heights[col] > features->max_height)
+        {
+            features->max_height = heights[col];
+        }
+        if (col > 0)
+        {
+            int32_t diff = heights[col] - heights[col - 1];
+            features->bumpiness += diff < 0 ? -diff : diff;
+        }
+    }
+}
+
+float ai_weighted_heuristic(const uint16_t *bitboard, int32_t lines,
+                            const void *params)
+{
+    const Ai_Weights *weights = (const Ai_Weights *)params;
+    Ai_Features features;
+    ai_compute_features(bitboard, lines, &features);
+    return weights->aggregate_height * features.aggregate_height +
+           weights->lines * features.lines +
+           weights->holes * features.holes +
+           weights->bumpiness * features.bumpiness;
+}
+
+int32_t ai_place_piece(uint16_t *bitboard, const Piece_State *piece)
+{
+    const Piece_Shape *shape = piece_shape(piece->tetromino_index,
+                                           piece->rotation);
+    int32_t shift = piece->offset_col + shape->min_col;
+    for (int32_t row = shape->min_row; row <= shape->max_row; ++row)
+    {
+        bitboard[piece->offset_row + row] |= (uint16_t)(shape->rows[row] <<
+                                                        shift);
+    }
+
+    int32_t lines = 0;
+    for (int32_t row = shape->min_row; row <= shape->max_row; ++row)
+    {
+        lines += check_row_filled(bitboard, piece->offset_row + row);
+    }
+    if (!lines)
+    {
+        return 0;
+    }
+
+    int32_t dst_row = HEIGHT - 1;
+    for (int32_t src_row = HEIGHT - 1; src_row >= 0; --src_row)
+    {
+        if (!check_row_filled(bitboard, src_row))
+        {
+            bitboard[dst_row--] = bitboard[src_row];
+        }
+    }
+    while (dst_row >= 0)
+    {
+        bitboard[dst_row--] = 0;
+    }
+    return lines;
+}
+
+static bool rotate_piece(const uint16_t *bitboard, Piece_State *piece,
+                         int32_t steps)
+{
+    // Three steps right is one step left.
+    int32_t direction = steps == 3 ? 3 : 1;
+    int32_t count = steps == 3 ? 1 : steps;
+    for (int32_t i = 0; i < count; ++i)
+    {
+        piece->rotation = (piece->rotation + direction) % 4;
+        if (!check_piece_valid(piece, bitboard))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+int32_t ai_enumerate_moves(const uint16_t *bitboard, const Piece_State *piece,
+                           Ai_Visit visit, void *user)
+{
+    int32_t count = 0;
+    if (!check_piece_valid(piece, bitboard))
+    {
+        return count;
+    }
+    for (int32_t steps = 0; steps < 4; ++steps)
+    {
+        Piece_State rotated = *piece;
+        if (!rotate_piece(bitboard, &rotated, steps))
+        {
+            continue;
+        }
+
+        // Left from the current column, then right of it.
+        for (int32_t direction = -1; direction <= 1; direction += 2)
+        {
+            Piece_State shifted = rotated;
+            if (direction > 0)
+            {
+                ++shifted.offset_col;
+            }
+            while (check_piece_valid(&shifted, bitboard))
+            {
+                Piece_State placement = shifted;
+                do
+                {
+                    ++placement.offset_row;
+                }
+                while (check_piece_valid(&placement, bitboard));
+                --placement.offset_row;
+
+                visit(user, &placement);
+                ++count;
+                shifted.offset_col += direction;
+            }
+        }
+    }
+    return count;
+}
+
+void ai_move_keys(Ai_Move *move, const Piece_State *from,
+                  const Piece_State *placement)
+{
+    move->key_count = 0;
+
+    int32_t steps = (placement->rotation - from->rotation + 4) % 4;
+    if (steps == 3)
+    {
+        move->keys[move->key_count++] = INPUT_KEY_LEFT;
+    }
+    for (int32_t i = 0; i < steps && steps < 3; ++i)
+    {
+        move->keys[move->key_count++] = INPUT_KEY_RIGHT;
+    }
+
+    int32_t shift = placement->offset_col - from->offset_col;
+    for (int32_t i = 0; i < shift; ++i)
+    {
+        move->keys[move->key_count++] = INPUT_KEY_D;
+    }
+    for (int32_t i = 0; i < -shift; ++i)
+    {
+        move->keys[move->key_count++] = INPUT_KEY_A;
+    }
+
+    move->keys[move->key_count++] = INPUT_KEY_SPACE;
+}
+
+struct Ai_Search
+{
+    const uint16_t *bitboard;
+    const Ai_Config *config;
+    Piece_State best;
+    int32_t best_lines;
+    float best_score;
+    bool found;
+};
+
+static void ai_search_consider(Ai_Search *search, const Piece_State *placement,
+                               int32_t lines, float score)
+{
+    if (!search->found || score > search->best_score)
+    {
+        search->found = true;
+        search->best = *placement;
+        search->best_lines = lines;
+        search->best_score = score;
+    }
+}
+
+static Ai_Move ai_search_move(const Ai_Search *search, const Piece_State *from)
+{
+    Ai_Move move = {};
+    if (search->found)
+    {
+        move.valid = true;
+        move.rotation = search->best.rotation;
+        move.offset_col = search->best.offset_col;
+        move.offset_row = search->best.offset_row;
+        move.lines = search->best_lines;
+        move.score = search->best_score;
+        ai_move_keys(&move, from, &search->best);
+    }
+    return move;
+}
+
+static void ai_search_visit(void *user, const Piece_State *placement)
+{
+    Ai_Search *search = (Ai_Search *)user;
+
+    uint16_t bitboard[HEIGHT];
+    memcpy(bitboard, search->bitboard, sizeof(bitboard));
+    int32_t lines = ai_place_piece(bitboard, placement);
+
+    float score = search->config->heuristic(bitboard, lines,
+                                            search->config->params);
+    ai_search_consider(search, placement, lines, score);
+}
+
+Ai_Move ai_find_best_move(const Game_State *game, const Ai_Config *config)
+{
+    Ai_Search search = {};
+    search.bitboard = game->bitboard;
+    search.config = config;
+    ai_enumerate_moves(game->bitboard, &game->piece, ai_search_visit,
+                       &search);
+    return ai_search_move(&search, &game->piece);
+}
+
+bool ai_table_init(Ai_Table *table, const Ai_Table_Config *config)
+{
+    *table = {};
+    size_t bucket_bytes = sizeof(Ai_Table_Entry) * AI_TABLE_WAYS;
+    if (config->max_bytes < bucket_bytes)
+    {
+        return false;
+    }
+
+    size_t bucket_count = 1;
+    while (bucket_count * 2 * bucket_bytes <= config->max_bytes &&
+           bucket_count < ((size_t)1 << 31))
+    {
+        bucket_count *= 2;
+    }
+    table->entries = new Ai_Table_Entry[bucket_count * AI_TABLE_WAYS]();
+    table->bucket_mask = (uint32_t)(bucket_count - 1);
+    table->policy = config->policy;
+    return true;
+}
+
+void ai_table_free(Ai_Table *table)
+{
+    delete[] table->entries;
+    *table = {};
+}
+
+void ai_table_clear(Ai_Table *table)
+{
+    if (table->entries)
+    {
+        size_t entry_count = ((size_t)table->bucket_mask + 1) * AI_TABLE_WAYS;
+        memset(table->entries, 0, entry_count * sizeof(Ai_Table_Entry));
+    }
+    table->generation = 0;
+    table->lookups = 0;
+    table->hits = 0;
+}
+
+static Ai_Table_Entry *ai_table_bucket(Ai_Table *table, uint64_t key)
+{
+    return &table->entries[(key & table->bucket_mask) * AI_TABLE_WAYS];
+}
+
+bool ai_table_lookup(Ai_Table *table, uint64_t key, float *value)
+{
+    if (!table->entries)
+    {
+        return false;
+    }
+
+    ++table->lookups;
+    Ai_Table_Entry *bucket = ai_table_bucket(table, key);
+    for (int32_t way = 0; way < AI_TABLE_WAYS; ++way)
+    {
+        if (bucket[way].key == key)
+        {
+            bucket[way].generation = table->generation;
+            *value = bucket[way].value;
+            ++table->hits;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ai_table_store(Ai_Table *table, uint64_t key, float value)
+{
+    if (!table->entries)
+    {
+        return;
+    }
+
+    Ai_Table_Entry *bucket = ai_table_bucket(table, key);
+    Ai_Table_Entry *entry = 0;
+    for (int32_t way = 0; way < AI_TABLE_WAYS && !entry; ++way)
+    {
+        if (bucket[way].key == key || bucket[way].key == 0)
+        {
+            entry = &bucket[way];
+        }
+    }
+
+    if (!entry && table->policy == AI_TABLE_REPLACE_ALWAYS)
+    {
+        memmove(bucket + 1, bucket,
+                sizeof(Ai_Table_Entry) * (AI_TABLE_WAYS - 1));
+        entry = &bucket[0];
+    }
+    else if (!entry)
+    {
+        entry = &bucket[0];
+        for (int32_t way = 1; way < AI_TABLE_WAYS; ++way)
+        {
+            uint32_t age = table->generation - bucket[way].generation;
+            if (age > table->generation - entry->generation)
+            {
+                entry = &bucket[way];
+            }
+        }
+    }
+
+    entry->key = key;
+    entry->value = value;
+    entry->generation = table->generation;
+}
+
+// tag separates boards that are searched differently, e.g. with another
+// next piece. Never returns the empty key.
+static uint64_t ai_board_key(const uint16_t *bitboard, uint32_t tag)
+{
+    uint64_t hash = 0xCBF29CE484222325ull ^ tag;
+    for (int32_t row = 0; row < HEIGHT; row += 4)
+    {
+        uint64_t word = 0;
+        for (int32_t i = 0; i < 4 && row + i < HEIGHT; ++i)
+        {
+            word |= (uint64_t)bitboard[row + i] << (16 * i);
+        }
+        hash = (hash ^ word) * 0x9E3779B97F4A7C15ull;
+        hash ^= hash >> 29;
+    }
+    hash *= 0xBF58476D1CE4E5B9ull;
+    hash ^= hash >> 32;
+    return hash | 1;
+}
+
+struct Ai_Lookahead
+{
+    Ai_Search search;
+    Ai_Table *table;
+    int32_t next_index;
+};
+
+struct Ai_Leaf_Search
+{
+    const uint16_t *bitboard;
+    const Ai_Config *config;
+    int32_t lines;
+    float best_score;
+    bool found;
+};
+
+static void ai_leaf_visit(void *user, const Piece_State *placement)
+{
+    Ai_Leaf_Search *leaf = (Ai_Leaf_Search *)user;
+
+    uint16_t bitboard[HEIGHT];
+    memcpy(bitboard, leaf->bitboard, sizeof(bitboard));
+    int32_t lines = leaf->lines + ai_place_piece(bitboard, placement);
+
+    float score = leaf->config->heuristic(bitboard, lines,
+                                          leaf->config->params);
+    if (!leaf->found || score > leaf->best_score)
+    {
+        leaf->found = true;
+        leaf->best_score = score;
+    }
+}
+
+static void ai_lookahead_visit(void *user, const Piece_State *placement)
+{
+    Ai_Lookahead *lookahead = (Ai_Lookahead *)user;
+    Ai_Search *search = &lookahead->search;
+
+    uint16_t bitboard[HEIGHT];
+    memcpy(bitboard, search->bitboard, sizeof(bitboard));
+    int32_t lines = ai_place_piece(bitboard, placement);
+
+    // The best continuation depends on the board, the next piece and the
+    // lines already cleared, as they are scored together at the leaf.
+    uint64_t key = ai_board_key(bitboard,
+                                (uint32_t)(lookahead->next_index << 8 | lines));
+    float score;
+    if (!lookahead->table ||
+        !ai_table_lookup(lookahead->table, key, &score))
+    {
+        Ai_Leaf_Search leaf = {};
+        leaf.bitboard = bitboard;
+        leaf.config = search->config;
+        leaf.lines = lines;
+
+        // Same spawn position as spawn_piece.
+        Piece_State next = {};
+        next.tetromino_index = lookahead->next_index;
+        next.offset_col = WIDTH / 2;
+        ai_enumerate_moves(bitboard, &next, ai_leaf_visit, &leaf);
+
+        score = leaf.found ? leaf.best_score : -FLT_MAX;
+        if (lookahead->table)
+        {
+            ai_table_store(lookahead->table, key, score);
+        }
+    }
+    ai_search_consider(search, placement, lines, score);
+}
+
+Ai_Move ai_find_best_move_lookahead(const Game_State *game,
+                                    const Ai_Config *config, Ai_Table *table)
+{
+    Ai_Lookahead lookahead = {};
+    lookahead.search.bitboard = game->bitboard;
+    lookahead.search.config = config;
+    lookahead.table = table && table->entries ? table : 0;
+    lookahead.next_index = game->tetromino_next;
+    if (lookahead.table)
+    {
+        ++table->generation;
+    }
+    ai_enumerate_moves(game->bitboard, &game->piece, ai_lookahead_visit,
+                       &lookahead);
+    return ai_search_move(&lookahead.search, &game->piece);
+}
+
+void ai_player_init(Ai_Player *player, const Ai_Config *config,
+                    Ai_Table *table)
+{
+    *player = {};
+    player->config = config;
+    player->table = table;
+}
+
+static Ai_Move ai_player_plan(Ai_Player *player, const Game_State *game)
+{
+    if (player->table)
+    {
+        return ai_find_best_move_lookahead(game, player->config,
+                                           player->table);
+    }
+    return ai_find_best_move(game, player->config);
+}
+
+static uint16_t ai_player_steer(const Ai_Move *move, const Piece_State *piece)
+{
+    if (!move->valid)
+    {
+        return INPUT_KEY_SPACE;
+    }
+    int32_t steps = (move->rotation - piece->rotation + 4) % 4;
+    if (steps == 3)
+    {
+        return INPUT_KEY_LEFT;
+    }
+    if (steps > 0)
+    {
+        return INPUT_KEY_RIGHT;
+    }
+    if (piece->offset_col < move->offset_col)
+    {
+        return INPUT_KEY_D;
+    }
+    if (piece->offset_col > move->offset_col)
+    {
+        return INPUT_KEY_A;
+    }
+    return INPUT_KEY_SPACE;
+}
+
+uint16_t ai_player_next_keys(Ai_Player *player, const Game_State *game)
+{
+    if (player->pressed)
+    {
+        player->pressed = false;
+        return INPUT_KEY_RELEASED;
+    }
+
+    if (game->phase == GAME_PHASE_START || game->phase == GAME_PHASE_GAMEOVER)
+    {
+        player->planned = false;
+        player->pressed = true;
+        return INPUT_KEY_SPACE;
+    }
+    if (game->phase != GAME_PHASE_PLAY)
+    {
+        return 0;
+    }
+
+    const Piece_State *last = &player->last_piece;
+    bool stuck = player->planned &&
+                 last->rotation == game->piece.rotation &&
+                 last->offset_col == game->piece.offset_col &&
+                 last->offset_row == game->piece.offset_row;
+    if (!player->planned || game->piece_count != player->piece_count)
+    {
+        player->move = ai_player_plan(player, game);
+        player->piece_count = game->piece_count;
+        player->replan_count = 0;
+        player->planned = true;
+    }
+    else if (stuck)
+    {
+        // Give up steering after a couple of attempts and just drop.
+        if (++player->replan_count > 2)
+        {
+            player->move.valid = false;
+        }
+        else
+        {
+            player->move = ai_player_plan(player, game);
+        }
+    }
+
+    player->last_piece = game->piece;
+    player->pressed = true;
+    return ai_player_steer(&player->move, &game->piece);
+}
+
+static void *ai_policy_create(uint32_t seed, const void *params)
+{
+    (void)seed;
+    (void)params;
+    Ai_Player *player = new Ai_Player();
+    ai_player_init(player, &AI_DEFAULT_CONFIG, 0);
+    return player;
+}
+
+static void ai_policy_destroy(void *context)
+{
+    delete (Ai_Player *)context;
+}
+
+static uint16_t ai_policy_next_keys(void *context, const Game_State *game)
+{
+    return ai_player_next_keys((Ai_Player *)context, game);
+}
+
+const Batch_Policy BATCH_POLICY_AI = {
+    "ai",
+    ai_policy_create,
+    ai_policy_destroy,
+    ai_policy_next_keys
+};
+
+struct Ai_Lookahead_Policy
+{
+    Ai_Player player;
+    Ai_Table table;
+};
+
+static void *ai_lookahead_policy_create(uint32_t seed, const void *params)
+{
+    (void)seed;
+    const Ai_Table_Config *config = (const Ai_Table_Config *)params;
+    if (!config)
+    {
+        config = &AI_DEFAULT_TABLE_CONFIG;
+    }
+
+    Ai_Lookahead_Policy *policy = new Ai_Lookahead_Policy();
+    ai_table_init(&policy->table, config);
+    ai_player_init(&policy->player, &AI_DEFAULT_CONFIG, &policy->table);
+    return policy;
+}
+
+static void ai_lookahead_policy_destroy(void *context)
+{
+    Ai_Lookahead_Policy *policy = (Ai_Lookahead_Policy *)context;
+    ai_table_free(&policy->table);
+    delete policy;
+}
+
+static uint16_t ai_lookahead_policy_next_keys(void *context,
+                                              const Game_State *game)
+{
+    Ai_Lookahead_Policy *policy = (Ai_Lookahead_Policy *)context;
+    return ai_player_next_keys(&policy->player, game);
+}
+
+const Batch_Policy BATCH_POLICY_AI_LOOKAHEAD = {
+    "lookahead",
+    ai_lookahead_policy_create,
+    ai_lookahead_policy_destroy,
+    ai_lookahead_policy_next_keys
+};
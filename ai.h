@@ -0,0 +1,162 @@
+#ifndef AI_H
+#define AI_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "tetris.h"
+#include "batch.h"
+
+// Placement search: every final position of the current piece reachable by
+// rotating at the current spot, shifting sideways and hard dropping, scored
+// by a pluggable heuristic on the resulting board.
+
+struct Ai_Features
+{
+    int32_t aggregate_height;
+    int32_t max_height;
+    int32_t holes;
+    int32_t bumpiness;
+    int32_t lines;
+};
+
+// Higher is better. bitboard is the board after the placement with full
+// lines already removed, lines is how many were cleared.
+typedef float (*Ai_Heuristic)(const uint16_t *bitboard, int32_t lines,
+                              const void *params);
+
+struct Ai_Weights
+{
+    float aggregate_height;
+    float lines;
+    float holes;
+    float bumpiness;
+};
+
+struct Ai_Config
+{
+    Ai_Heuristic heuristic;
+    const void *params;
+};
+
+// Weights tuned for the classic height/lines/holes/bumpiness heuristic.
+extern const Ai_Weights AI_DEFAULT_WEIGHTS;
+extern const Ai_Config AI_DEFAULT_CONFIG;
+
+#define AI_MAX_MOVE_KEYS 16
+
+struct Ai_Move
+{
+    bool valid;
+    int32_t rotation;
+    int32_t offset_col;
+    int32_t offset_row;
+    int32_t lines;
+    float score;
+    // Key presses from the current piece position, the last one drops.
+    int32_t key_count;
+    uint16_t keys[AI_MAX_MOVE_KEYS];
+};
+
+void ai_compute_features(const uint16_t *bitboard, int32_t lines,
+                         Ai_Features *features);
+float ai_weighted_heuristic(const uint16_t *bitboard, int32_t lines,
+                            const void *params);
+
+// Places piece on bitboard and removes full rows, returns the line count.
+int32_t ai_place_piece(uint16_t *bitboard, const Piece_State *piece);
+
+// Calls visit for every reachable placement of piece, returns the count.
+typedef void (*Ai_Visit)(void *user, const Piece_State *placement);
+int32_t ai_enumerate_moves(const uint16_t *bitboard, const Piece_State *piece,
+                           Ai_Visit visit, void *user);
+
+// Fills the key presses that take from to placement.
+void ai_move_keys(Ai_Move *move, const Piece_State *from,
+                  const Piece_State *placement);
+
+Ai_Move ai_find_best_move(const Game_State *game, const Ai_Config *config);
+
+// Transposition table of evaluated boards for the lookahead search. Keys are
+// a hash of the post-clear board plus what is left to search from it, so a
+// board reached through different placements is only evaluated once. The
+// table is a fixed array of two-way buckets that never grows.
+enum Ai_Table_Policy
+{
+    // New boards always go in the first way, pushing its entry to the second.
+    AI_TABLE_REPLACE_ALWAYS,
+    // New boards replace the way least recently used by a search.
+    AI_TABLE_REPLACE_OLDEST,
+};
+
+struct Ai_Table_Config
+{
+    // Upper bound on memory, rounded down to a power of two bucket count.
+    size_t max_bytes;
+    Ai_Table_Policy policy;
+};
+
+extern const Ai_Table_Config AI_DEFAULT_TABLE_CONFIG;
+
+#define AI_TABLE_WAYS 2
+
+struct Ai_Table_Entry
+{
+    // Zero marks an empty entry.
+    uint64_t key;
+    float value;
+    uint32_t generation;
+};
+
+struct Ai_Table
+{
+    Ai_Table_Entry *entries;
+    uint32_t bucket_mask;
+    Ai_Table_Policy policy;
+    // Bumped once per search, used to find the oldest entry.
+    uint32_t generation;
+    uint64_t lookups;
+    uint64_t hits;
+};
+
+// Fails and leaves the table empty when max_bytes is below one bucket.
+bool ai_table_init(Ai_Table *table, const Ai_Table_Config *config);
+void ai_table_free(Ai_Table *table);
+void ai_table_clear(Ai_Table *table);
+// An empty table misses every lookup and ignores stores.
+bool ai_table_lookup(Ai_Table *table, uint64_t key, float *value);
+void ai_table_store(Ai_Table *table, uint64_t key, float value);
+
+// Two-ply search over the current piece and tetromino_next. Each pair of
+// placements is scored by the heuristic on the final board with the lines of
+// both plies. table may be null, or failed to init, to search without
+// caching.
+Ai_Move ai_find_best_move_lookahead(const Game_State *game,
+                                    const Ai_Config *config, Ai_Table *table);
+
+// Plays a game by steering the piece towards the best move one key press at
+// a time, with a release between presses. It re-plans when a press had no
+// effect, e.g. because gravity moved the piece into the way. With a table,
+// even an empty one, it plans with the lookahead search.
+struct Ai_Player
+{
+    const Ai_Config *config;
+    Ai_Table *table;
+    Ai_Move move;
+    Piece_State last_piece;
+    int32_t piece_count;
+    int32_t replan_count;
+    bool planned;
+    bool pressed;
+};
+
+void ai_player_init(Ai_Player *player, const Ai_Config *config,
+                    Ai_Table *table);
+uint16_t ai_player_next_keys(Ai_Player *player, const Game_State *game);
+
+// Batch policies using the default configuration. The lookahead policy takes
+// an optional Ai_Table_Config as its params.
+extern const Batch_Policy BATCH_POLICY_AI;
+extern const Batch_Policy BATCH_POLICY_AI_LOOKAHEAD;
+
+#endif
@@ -29,6 +29,7 @@
 #endif
 
 #include "audio.h"
+#include "mixer.h"
 
 /*
  * Native WAVE format
@@ -48,12 +49,28 @@
 /* 1 mono, 2 stereo, 4 quad, 6 (5.1) */
 #define AUDIO_CHANNELS 1
 
-/* Specifies a unit of audio data to be used at a time. Must be a power of 2 */
+/* Specifies a unit of audio data to be used at a time. Must be a power of 2
+ * AUDIO_SAMPLES_AUTO tries sizes from AUDIO_SAMPLES_MIN up, falling back to AUDIO_SAMPLES
+ */
 #define AUDIO_SAMPLES 4096
+#define AUDIO_SAMPLES_MIN 256
+
+/* How long each buffer size is tried, and the longest gap between callbacks it may show in buffer lengths */
+#define AUDIO_PROBE_MS 250
+#define AUDIO_PROBE_MAX_GAP 1.5
 
 /* Max number of sounds that can be in the audio queue at anytime, stops too much mixing */
 #define AUDIO_MAX_SOUNDS 25
 
+/* Max number of musics in the queue, the new one and those fading out */
+#define AUDIO_MAX_MUSIC 2
+
+/* Every playing sound or music takes one voice from a pool allocated in initAudio */
+#define AUDIO_MAX_VOICES (AUDIO_MAX_SOUNDS + AUDIO_MAX_MUSIC)
+
+/* Slots in each command ring, a power of 2 above AUDIO_MAX_VOICES so returned voices always fit */
+#define AUDIO_RING_SIZE 64
+
 /* Flags OR'd together, which specify how SDL should behave when a device cannot offer a specific feature
  * If flag is set, SDL will change the format in the actual audio file structure (as opposed to gDevice->want)
  *
@@ -64,28 +81,159 @@
  * SDL_AUDIO_ALLOW_FORMAT_CHANGE        Allow Format change (e.g. AUDIO_FORMAT may be S32LSB, but allow wave files of S16LSB to play)
  * SDL_AUDIO_ALLOW_CHANNELS_CHANGE      Allow any number of channels (e.g. AUDIO_CHANNELS being 2, allow actual 1)
  * SDL_AUDIO_ALLOW_ANY_CHANGE           Allow all changes above
+ *
+ * The mixer writes AUDIO_FORMAT, so a format change is never allowed and SDL converts instead
  */
 #ifdef _WIN32
 #define SDL_AUDIO_ALLOW_CHANGES SDL_AUDIO_ALLOW_FREQUENCY_CHANGE
 #else
-#define SDL_AUDIO_ALLOW_CHANGES SDL_AUDIO_ALLOW_ANY_CHANGE
+#define SDL_AUDIO_ALLOW_CHANGES (SDL_AUDIO_ALLOW_ANY_CHANGE & ~SDL_AUDIO_ALLOW_FORMAT_CHANGE)
 #endif
 
+/* Time the master limiter takes to recover after loud mixes */
+#define AUDIO_LIMITER_RELEASE_MS 50
+
+/*
+ * Clip in the sound bank, already in the device format
+ *
+ */
+typedef struct soundClip
+{
+    uint32_t offset;
+    uint32_t length;
+} SoundClip;
+
+/*
+ * Commands passed between the game thread and the audio callback
+ *
+ */
+typedef enum
+{
+    AUDIO_COMMAND_PLAY,         /* Game to callback, start voice */
+    AUDIO_COMMAND_STOP,         /* Game to callback, end every voice */
+    AUDIO_COMMAND_DONE          /* Callback to game, voice finished and can be reused */
+} AudioCommandType;
+
+typedef struct audioCommand
+{
+    AudioCommandType type;
+    Audio * voice;
+} AudioCommand;
+
+/*
+ * Single producer, single consumer ring, head is only written by the producer and tail only by the consumer
+ *
+ */
+typedef struct audioRing
+{
+    AudioCommand commands[AUDIO_RING_SIZE];
+    SDL_atomic_t head;
+    SDL_atomic_t tail;
+} AudioRing;
+
 /*
  * Definition for the game global sound device
  *
+ * The game thread owns freeVoices and the sound count, the callback owns the list of playing voices,
+ * they only talk through the two rings so neither waits on the other
+ *
  */
 typedef struct privateAudioDevice
 {
     SDL_AudioDeviceID device;
     SDL_AudioSpec want;
+    SDL_AudioSpec have;
     uint8_t audioEnabled;
+    uint8_t measureLatency;
+    Audio * voices;
+    Audio * freeVoices;
+    int32_t * mix;
+    Mixer_Limiter limiter;
+    uint8_t * bank;
+    SoundClip * clips;
+    int clipCount;
+    AudioRing toCallback;
+    AudioRing fromCallback;
+
+    /* Written by the callback, read while the device is paused */
+    uint64_t lastCallback;
+    uint64_t maxCallbackGap;
+    uint32_t callbackCount;
+    uint64_t latencyTotal;
+    uint64_t latencyMax;
+    uint32_t latencyCount;
 } PrivateAudioDevice;
 
 /* File scope variables to persist data */
 static PrivateAudioDevice * gDevice;
 static uint32_t gSoundCount;
 
+/*
+ * Add a command to a ring, called only from the ring's producer
+ *
+ * @return 1 on success, 0 if the ring is full
+ *
+ */
+static int pushCommand(AudioRing * ring, AudioCommandType type, Audio * voice);
+
+/*
+ * Take the oldest command from a ring, called only from the ring's consumer
+ *
+ * @return 1 on success, 0 if the ring is empty
+ *
+ */
+static int popCommand(AudioRing * ring, AudioCommand * command);
+
+/*
+ * Open the device with a buffer of samples, the obtained spec is kept in gDevice->have
+ *
+ * @return 1 on success, 0 on failure
+ *
+ */
+static int openAudioDevice(uint16_t samples);
+
+/*
+ * Play silence for AUDIO_PROBE_MS and check the callback kept up with the device
+ *
+ * @return 1 if no callback came more than AUDIO_PROBE_MAX_GAP buffers after the one before
+ *
+ */
+static int probeAudioDevice(void);
+
+/*
+ * Print the buffer size and the play call to first mix latency gathered by the callback, device must be paused
+ *
+ */
+static void printAudioLatency(void);
+
+/*
+ * Convert a loaded wave to the obtained device spec
+ *
+ * @param spec      Spec of the wave
+ * @param buffer    Wave from SDL_LoadWAV, replaced by a malloc'd buffer when converted
+ * @param length    Length in bytes, updated to the converted length
+ *
+ * @return 1 if *buffer must now be released with free(), 0 if it is still the SDL_LoadWAV buffer, -1 on failure
+ *
+ */
+static int convertClip(const SDL_AudioSpec * spec, uint8_t ** buffer, uint32_t * length);
+
+/*
+ * Plays a clip from the sound bank
+ *
+ * @param sound     Handle from loadSoundBank
+ * @param loop      1 if looping (music), 0 otherwise (sound)
+ * @param volume    See playSound for explanation
+ *
+ */
+static void playClip(SoundHandle sound, uint8_t loop, uint8_t volume);
+
+/*
+ * Take back the voices the callback has finished with, game thread only
+ *
+ */
+static void reclaimVoices(void);
+
 /*
  * Add a music to the queue, addAudio wrapper for music due to fade
  *
@@ -114,6 +262,16 @@ static inline void playAudio(const char * filename, Audio * audio, uint8_t loop,
  */
 static void addAudio(Audio * root, Audio * newx);
 
+/*
+ * Remove a voice from the playing list and hand it back to the game thread
+ *
+ * @param previous  Voice before the one to remove, or the place holder
+ *
+ * @return the voice that followed the removed one
+ *
+ */
+static Audio * retireAudio(Audio * previous);
+
 /*
  * Audio callback function for OpenAudioDevice
  *
@@ -144,9 +302,28 @@ void playMusicFromMemory(Audio * audio, uint8_t volume)
     playAudio(NULL, audio, 1, volume);
 }
 
-void initAudio(void)
+void playSoundFromBank(SoundHandle sound, uint8_t volume)
+{
+    playClip(sound, 0, volume);
+}
+
+void playMusicFromBank(SoundHandle sound, uint8_t volume)
+{
+    playClip(sound, 1, volume);
+}
+
+void stopAudio(void)
+{
+    if(gDevice->audioEnabled)
+    {
+        pushCommand(&(gDevice->toCallback), AUDIO_COMMAND_STOP, NULL);
+    }
+}
+
+void initAudio(uint16_t samples, uint8_t measureLatency)
 {
     Audio * global;
+    int i;
     gDevice = (PrivateAudioDevice*)calloc(1, sizeof(PrivateAudioDevice));
     gSoundCount = 0;
 
@@ -157,6 +334,7 @@ void initAudio(void)
     }
 
     gDevice->audioEnabled = 0;
+    gDevice->measureLatency = measureLatency;
 
     if(!(SDL_WasInit(SDL_INIT_AUDIO) & SDL_INIT_AUDIO))
     {
@@ -164,12 +342,26 @@ void initAudio(void)
         return;
     }
 
+    gDevice->voices = (Audio*)calloc(AUDIO_MAX_VOICES, sizeof(Audio));
+
+    if(gDevice->voices == NULL)
+    {
+        fprintf(stderr, "[%s: %d]Error: Memory allocation error\n", __FILE__, __LINE__);
+        return;
+    }
+
+    /* All voices start out unused, linked through next */
+    for(i = AUDIO_MAX_VOICES - 1; i >= 0; i--)
+    {
+        gDevice->voices[i].next = gDevice->freeVoices;
+        gDevice->freeVoices = &(gDevice->voices[i]);
+    }
+
     SDL_memset(&(gDevice->want), 0, sizeof(gDevice->want));
 
     (gDevice->want).freq = AUDIO_FREQUENCY;
     (gDevice->want).format = AUDIO_FORMAT;
     (gDevice->want).channels = AUDIO_CHANNELS;
-    (gDevice->want).samples = AUDIO_SAMPLES;
     (gDevice->want).callback = audioCallback;
     (gDevice->want).userdata = calloc(1, sizeof(Audio));
 
@@ -184,33 +376,146 @@ void initAudio(void)
     global->buffer = NULL;
     global->next = NULL;
 
-    /* want.userdata = newx; */
-    if((gDevice->device = SDL_OpenAudioDevice(NULL, 0, &(gDevice->want), NULL, SDL_AUDIO_ALLOW_CHANGES)) == 0)
+    if(samples != AUDIO_SAMPLES_AUTO)
     {
-        fprintf(stderr, "[%s: %d]Warning: failed to open audio device: %s\n", __FILE__, __LINE__, SDL_GetError());
+        if(!openAudioDevice(samples))
+        {
+            return;
+        }
     }
     else
     {
-        /* Set audio device enabled global flag */
-        gDevice->audioEnabled = 1;
+        /* Smallest buffer the device keeps up with, a late callback means the device ran dry */
+        for(samples = AUDIO_SAMPLES_MIN; samples < AUDIO_SAMPLES; samples *= 2)
+        {
+            if(!openAudioDevice(samples))
+            {
+                return;
+            }
+
+            if(probeAudioDevice())
+            {
+                break;
+            }
+
+            SDL_CloseAudioDevice(gDevice->device);
+        }
 
-        /* Unpause active audio stream */
-        unpauseAudio();
+        if(samples == AUDIO_SAMPLES && !openAudioDevice(samples))
+        {
+            return;
+        }
     }
+
+    /* Set audio device enabled global flag */
+    gDevice->audioEnabled = 1;
+
+    /* Unpause active audio stream */
+    unpauseAudio();
+}
+
+static int openAudioDevice(uint16_t samples)
+{
+    (gDevice->want).samples = samples;
+
+    if((gDevice->device = SDL_OpenAudioDevice(NULL, 0, &(gDevice->want), &(gDevice->have), SDL_AUDIO_ALLOW_CHANGES)) == 0)
+    {
+        fprintf(stderr, "[%s: %d]Warning: failed to open audio device: %s\n", __FILE__, __LINE__, SDL_GetError());
+        return 0;
+    }
+
+    /* One 32 bit sum per sample of the buffer, sized for the spec obtained */
+    free(gDevice->mix);
+    gDevice->mix = (int32_t*)calloc((gDevice->have).size / sizeof(int16_t), sizeof(int32_t));
+
+    if(gDevice->mix == NULL)
+    {
+        fprintf(stderr, "[%s: %d]Error: Memory allocation error\n", __FILE__, __LINE__);
+        SDL_CloseAudioDevice(gDevice->device);
+        return 0;
+    }
+
+    mixer_limiter_init(&(gDevice->limiter), (gDevice->have).freq * (gDevice->have).channels * AUDIO_LIMITER_RELEASE_MS / 1000);
+
+    return 1;
+}
+
+static int probeAudioDevice(void)
+{
+    double period = (double)(gDevice->have).samples / (gDevice->have).freq;
+
+    gDevice->lastCallback = 0;
+    gDevice->maxCallbackGap = 0;
+    gDevice->callbackCount = 0;
+
+    SDL_PauseAudioDevice(gDevice->device, 0);
+    SDL_Delay(AUDIO_PROBE_MS);
+
+    /* Pausing waits for a running callback, so its counters are safe to read after */
+    SDL_PauseAudioDevice(gDevice->device, 1);
+
+    return gDevice->callbackCount > 1 &&
+           (double)gDevice->maxCallbackGap / SDL_GetPerformanceFrequency() <= AUDIO_PROBE_MAX_GAP * period;
+}
+
+static void printAudioLatency(void)
+{
+    double frequency = (double)SDL_GetPerformanceFrequency();
+    double buffer = 1000.0 * (gDevice->have).samples / (gDevice->have).freq;
+
+    printf("audio buffer: %u samples at %d Hz (%.1f ms)\n", (gDevice->have).samples, (gDevice->have).freq, buffer);
+
+    if(gDevice->latencyCount == 0)
+    {
+        printf("audio latency: no sounds played\n");
+        return;
+    }
+
+    /* The mixed buffer is queued behind the one playing, so up to another buffer passes before it is heard */
+    printf("audio latency: %u sounds, trigger to first mix mean %.2f ms max %.2f ms, plus up to %.1f ms until output\n",
+           gDevice->latencyCount,
+           1000.0 * gDevice->latencyTotal / gDevice->latencyCount / frequency,
+           1000.0 * gDevice->latencyMax / frequency,
+           buffer);
 }
 
 void endAudio(void)
 {
+    int i;
+
     if(gDevice->audioEnabled)
     {
         pauseAudio();
 
-        freeAudio((Audio *) (gDevice->want).userdata);
+        if(gDevice->measureLatency)
+        {
+            printAudioLatency();
+        }
+
+        /* Only the place holder, the voices after it belong to the pool */
+        free((gDevice->want).userdata);
 
         /* Close down audio */
         SDL_CloseAudioDevice(gDevice->device);
     }
 
+    if(gDevice->voices != NULL)
+    {
+        /* Voices of loaded files keep their wave until reused */
+        for(i = 0; i < AUDIO_MAX_VOICES; i++)
+        {
+            if(gDevice->voices[i].free == 1)
+            {
+                SDL_FreeWAV(gDevice->voices[i].bufferTrue);
+            }
+        }
+
+        free(gDevice->voices);
+    }
+
+    free(gDevice->mix);
+    free(gDevice->bank);
+    free(gDevice->clips);
     free(gDevice);
 }
 
@@ -289,54 +594,261 @@ Audio * createAudio(const char * filename, uint8_t loop, uint8_t volume)
     return newx;
 }
 
-static inline void playAudio(const char * filename, Audio * audio,
-                             uint8_t loop, uint8_t volume)
+static int convertClip(const SDL_AudioSpec * spec, uint8_t ** buffer, uint32_t * length)
 {
-    Audio * newx;
+    SDL_AudioCVT cvt;
+    uint32_t frame = (uint32_t) ((gDevice->have).channels * sizeof(int16_t));
+    int needed = SDL_BuildAudioCVT(&cvt, spec->format, spec->channels, spec->freq,
+                                   AUDIO_FORMAT, (gDevice->have).channels, (gDevice->have).freq);
 
-    /* Check if audio is enabled */
-    if(!gDevice->audioEnabled)
+    if(needed < 0)
     {
-        return;
+        return -1;
+    }
+    else if(needed == 0)
+    {
+        /* Whole frames only so the mixer never reads half a sample */
+        *length -= *length % frame;
+        return 0;
     }
 
-    /* If sound, check if under max number of sounds allowed, else don't play */
-    if(loop == 0)
+    cvt.len = (int) *length;
+    cvt.buf = (uint8_t*)malloc((size_t) *length * cvt.len_mult);
+
+    if(cvt.buf == NULL)
+    {
+        return -1;
+    }
+
+    SDL_memcpy(cvt.buf, *buffer, *length);
+
+    if(SDL_ConvertAudio(&cvt) < 0)
+    {
+        free(cvt.buf);
+        return -1;
+    }
+
+    SDL_FreeWAV(*buffer);
+    *buffer = cvt.buf;
+    *length = (uint32_t) cvt.len_cvt - (uint32_t) cvt.len_cvt % frame;
+
+    return 1;
+}
+
+int loadSoundBank(const char * const * filenames, int count, SoundHandle * handles)
+{
+    uint8_t ** buffers;
+    uint8_t * converted;
+    uint32_t total = 0;
+    int loaded = 0;
+    int i;
+    SDL_AudioSpec spec;
+
+    for(i = 0; i < count; i++)
     {
-        if(gSoundCount >= AUDIO_MAX_SOUNDS)
+        handles[i] = AUDIO_NO_SOUND;
+    }
+
+    if(!gDevice->audioEnabled || gDevice->bank != NULL)
+    {
+        return 0;
+    }
+
+    buffers = (uint8_t**)calloc(count, sizeof(uint8_t*));
+    converted = (uint8_t*)calloc(count, sizeof(uint8_t));
+    gDevice->clips = (SoundClip*)calloc(count, sizeof(SoundClip));
+
+    if(buffers == NULL || converted == NULL || gDevice->clips == NULL)
+    {
+        fprintf(stderr, "[%s: %d]Error: Memory allocation error\n", __FILE__, __LINE__);
+        free(buffers);
+        free(converted);
+        free(gDevice->clips);
+        gDevice->clips = NULL;
+        return 0;
+    }
+
+    /* Each file is read and converted once, then packed behind the ones before it */
+    for(i = 0; i < count; i++)
+    {
+        int result;
+
+        if(SDL_LoadWAV(filenames[i], &spec, &(buffers[i]), &(gDevice->clips[i].length)) == NULL)
         {
-            return;
+            fprintf(stderr, "[%s: %d]Warning: failed to open wave file: %s error: %s\n", __FILE__, __LINE__, filenames[i], SDL_GetError());
+            buffers[i] = NULL;
+            gDevice->clips[i].offset = total;
+            gDevice->clips[i].length = 0;
+            continue;
         }
-        else
+
+        result = convertClip(&spec, &(buffers[i]), &(gDevice->clips[i].length));
+
+        if(result < 0)
         {
-            gSoundCount++;
+            fprintf(stderr, "[%s: %d]Warning: failed to convert wave file: %s error: %s\n", __FILE__, __LINE__, filenames[i], SDL_GetError());
+            SDL_FreeWAV(buffers[i]);
+            buffers[i] = NULL;
+            gDevice->clips[i].offset = total;
+            gDevice->clips[i].length = 0;
+            continue;
         }
+
+        converted[i] = (uint8_t) result;
+        gDevice->clips[i].offset = total;
+        total += gDevice->clips[i].length;
     }
 
-    /* Load from filename or from Memory */
-    if(filename != NULL)
+    gDevice->bank = (uint8_t*)malloc(total > 0 ? total : 1);
+
+    if(gDevice->bank == NULL)
     {
-        /* Create new music sound with loop */
-        newx = createAudio(filename, loop, volume);
+        fprintf(stderr, "[%s: %d]Error: Memory allocation error\n", __FILE__, __LINE__);
     }
-    else if(audio != NULL)
+
+    for(i = 0; i < count; i++)
     {
-        newx = (Audio*)malloc(sizeof(Audio));
+        if(buffers[i] == NULL)
+        {
+            continue;
+        }
 
-        if(newx == NULL)
+        if(gDevice->bank != NULL)
         {
-            fprintf(stderr, "[%s: %d]Fatal Error: Memory allocation error\n",
-                    __FILE__, __LINE__);
-            return;
+            SDL_memcpy(gDevice->bank + gDevice->clips[i].offset, buffers[i], gDevice->clips[i].length);
+            handles[i] = i;
+            loaded++;
         }
 
-        memcpy(newx, audio, sizeof(Audio));
+        if(converted[i])
+        {
+            free(buffers[i]);
+        }
+        else
+        {
+            SDL_FreeWAV(buffers[i]);
+        }
+    }
 
-        newx->volume = volume;
-        newx->loop = loop;
-        newx->free = 0;
+    if(gDevice->bank != NULL)
+    {
+        gDevice->clipCount = count;
     }
     else
+    {
+        free(gDevice->clips);
+        gDevice->clips = NULL;
+    }
+
+    free(buffers);
+    free(converted);
+
+    return loaded;
+}
+
+static void playClip(SoundHandle sound, uint8_t loop, uint8_t volume)
+{
+    Audio clip;
+
+    /* Clips that failed to load are empty */
+    if(!gDevice->audioEnabled || sound < 0 || sound >= gDevice->clipCount || gDevice->clips[sound].length == 0)
+    {
+        return;
+    }
+
+    SDL_memset(&clip, 0, sizeof(clip));
+    clip.bufferTrue = gDevice->bank + gDevice->clips[sound].offset;
+    clip.buffer = clip.bufferTrue;
+    clip.lengthTrue = gDevice->clips[sound].length;
+    clip.length = clip.lengthTrue;
+
+    playAudio(NULL, &clip, loop, volume);
+}
+
+static int pushCommand(AudioRing * ring, AudioCommandType type, Audio * voice)
+{
+    int head = SDL_AtomicGet(&(ring->head));
+
+    if(head - SDL_AtomicGet(&(ring->tail)) == AUDIO_RING_SIZE)
+    {
+        return 0;
+    }
+
+    ring->commands[head % AUDIO_RING_SIZE].type = type;
+    ring->commands[head % AUDIO_RING_SIZE].voice = voice;
+
+    /* Publish the command only after it is written */
+    SDL_AtomicSet(&(ring->head), head + 1);
+
+    return 1;
+}
+
+static int popCommand(AudioRing * ring, AudioCommand * command)
+{
+    int tail = SDL_AtomicGet(&(ring->tail));
+
+    if(tail == SDL_AtomicGet(&(ring->head)))
+    {
+        return 0;
+    }
+
+    *command = ring->commands[tail % AUDIO_RING_SIZE];
+
+    /* Free the slot only after it is read */
+    SDL_AtomicSet(&(ring->tail), tail + 1);
+
+    return 1;
+}
+
+static void reclaimVoices(void)
+{
+    AudioCommand command;
+
+    while(popCommand(&(gDevice->fromCallback), &command))
+    {
+        if(command.voice->loop == 0)
+        {
+            gSoundCount--;
+        }
+
+        /* Waves of files loaded by playSound and playMusic are owned by their voice */
+        if(command.voice->free == 1)
+        {
+            SDL_FreeWAV(command.voice->bufferTrue);
+            command.voice->free = 0;
+        }
+
+        command.voice->next = gDevice->freeVoices;
+        gDevice->freeVoices = command.voice;
+    }
+}
+
+static inline void playAudio(const char * filename, Audio * audio,
+                             uint8_t loop, uint8_t volume)
+{
+    Audio * loaded = NULL;
+    Audio * voice;
+
+    /* Check if audio is enabled */
+    if(!gDevice->audioEnabled)
+    {
+        return;
+    }
+
+    /* Load from filename or from Memory */
+    if(filename != NULL)
+    {
+        /* Create new music sound with loop, the voice takes over its wave */
+        loaded = createAudio(filename, loop, volume);
+
+        if(loaded == NULL)
+        {
+            return;
+        }
+
+        audio = loaded;
+    }
+    else if(audio == NULL)
     {
         fprintf(stderr,
                 "[%s: %d]Warning: filename and Audio parameters NULL\n",
@@ -344,20 +856,46 @@ static inline void playAudio(const char * filename, Audio * audio,
         return;
     }
 
-    /* Lock callback function */
-    SDL_LockAudioDevice(gDevice->device);
+    reclaimVoices();
 
-    if(loop == 1)
+    voice = gDevice->freeVoices;
+
+    /* If sound, check if under max number of sounds allowed, else don't play */
+    if(voice == NULL || (loop == 0 && gSoundCount >= AUDIO_MAX_SOUNDS))
     {
-        addMusic((Audio *) (gDevice->want).userdata, newx);
+        freeAudio(loaded);
+        return;
     }
-    else
+
+    gDevice->freeVoices = voice->next;
+
+    voice->next = NULL;
+    voice->length = audio->length;
+    voice->lengthTrue = audio->lengthTrue;
+    voice->bufferTrue = audio->bufferTrue;
+    voice->buffer = audio->buffer;
+    voice->loop = loop;
+    voice->fade = 0;
+    voice->free = (loaded != NULL) ? 1 : 0;
+    voice->volume = volume;
+    voice->triggered = gDevice->measureLatency ? SDL_GetPerformanceCounter() : 0;
+
+    /* The callback owns the voice from here on, or it goes straight back when the ring is full */
+    if(!pushCommand(&(gDevice->toCallback), AUDIO_COMMAND_PLAY, voice))
     {
-        addAudio((Audio *) (gDevice->want).userdata, newx);
+        voice->free = 0;
+        voice->next = gDevice->freeVoices;
+        gDevice->freeVoices = voice;
+        freeAudio(loaded);
+        return;
     }
 
-    SDL_UnlockAudioDevice(gDevice->device);
+    if(loop == 0)
+    {
+        gSoundCount++;
+    }
 
+    free(loaded);
 }
 
 static void addMusic(Audio * root, Audio * newx)
@@ -395,11 +933,53 @@ static inline void audioCallback(void * userdata, uint8_t * stream, int len)
 {
     Audio * audio = (Audio *) userdata;
     Audio * previous = audio;
+    AudioCommand command;
     int tempLength;
     uint8_t music = 0;
+    uint64_t now = SDL_GetPerformanceCounter();
+
+    if(gDevice->lastCallback != 0 && now - gDevice->lastCallback > gDevice->maxCallbackGap)
+    {
+        gDevice->maxCallbackGap = now - gDevice->lastCallback;
+    }
+
+    gDevice->lastCallback = now;
+    gDevice->callbackCount++;
+
+    /* Start what the game thread asked for since the last buffer */
+    while(popCommand(&(gDevice->toCallback), &command))
+    {
+        if(command.type == AUDIO_COMMAND_PLAY && gDevice->measureLatency)
+        {
+            /* Commands are drained before mixing, so this buffer holds the voice's first samples */
+            gDevice->latencyTotal += now - command.voice->triggered;
+            gDevice->latencyCount++;
+
+            if(now - command.voice->triggered > gDevice->latencyMax)
+            {
+                gDevice->latencyMax = now - command.voice->triggered;
+            }
+        }
+
+        if(command.type == AUDIO_COMMAND_PLAY && command.voice->loop == 1)
+        {
+            addMusic((Audio *) userdata, command.voice);
+        }
+        else if(command.type == AUDIO_COMMAND_PLAY)
+        {
+            addAudio((Audio *) userdata, command.voice);
+        }
+        else if(command.type == AUDIO_COMMAND_STOP)
+        {
+            while(audio->next != NULL)
+            {
+                retireAudio(audio);
+            }
+        }
+    }
 
-    /* Silence the main buffer */
-    SDL_memset(stream, 0, len);
+    /* Silence the mix, voices are summed there and written to the stream once at the end */
+    mixer_clear(gDevice->mix, (int32_t) (len / sizeof(int16_t)));
 
     /* First one is place holder */
     audio = audio->next;
@@ -432,8 +1012,7 @@ static inline void audioCallback(void * userdata, uint8_t * stream, int len)
                     len > audio->length) ? audio->length : (uint32_t) len;
             }
 
-            SDL_MixAudioFormat(stream, audio->buffer, AUDIO_FORMAT, tempLength,
-                               audio->volume);
+            mixer_add(gDevice->mix, (const int16_t *) audio->buffer, (int32_t) (tempLength / sizeof(int16_t)), audio->volume);
 
             audio->buffer += tempLength;
             audio->length -= tempLength;
@@ -448,19 +1027,24 @@ static inline void audioCallback(void * userdata, uint8_t * stream, int len)
         }
         else
         {
-            previous->next = audio->next;
+            audio = retireAudio(previous);
+        }
+    }
 
-            if(audio->loop == 0)
-            {
-                gSoundCount--;
-            }
+    mixer_output(gDevice->mix, (int16_t *) stream, (int32_t) (len / sizeof(int16_t)), &(gDevice->limiter));
+}
 
-            audio->next = NULL;
-            freeAudio(audio);
+static Audio * retireAudio(Audio * previous)
+{
+    Audio * audio = previous->next;
 
-            audio = previous->next;
-        }
-    }
+    previous->next = audio->next;
+    audio->next = NULL;
+
+    /* Back to the game thread, nothing is freed on the audio thread. The ring holds every voice so this cannot fail */
+    pushCommand(&(gDevice->fromCallback), AUDIO_COMMAND_DONE, audio);
+
+    return previous->next;
 }
 
 static void addAudio(Audio * root, Audio * newx)
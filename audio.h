@@ -51,12 +51,22 @@ typedef struct sound
     uint8_t fade;
     uint8_t free;
     uint8_t volume;
+    uint64_t triggered;
 
     SDL_AudioSpec audio;
 
     struct sound * next;
 } Audio;
 
+/*
+ * Handle to a clip in the sound bank, an index into its clip table
+ *
+ */
+typedef int32_t SoundHandle;
+
+/* Handle of a clip that failed to load, playing it does nothing */
+#define AUDIO_NO_SOUND -1
+
 /*
  * Create a Audio object
  *
@@ -96,7 +106,7 @@ void playSound(const char * filename, uint8_t volume);
 void playMusic(const char * filename, uint8_t volume);
 
 /*
- * Plays a sound from a createAudio object (clones), only 1 at a time plays
+ * Plays a sound from a createAudio object on a voice from the preallocated pool, nothing is allocated
  * Advantage to this method is no more disk reads, only once, data is stored and constantly reused
  *
  * @param audio         Audio object to clone and use
@@ -106,7 +116,7 @@ void playMusic(const char * filename, uint8_t volume);
 void playSoundFromMemory(Audio * audio, uint8_t volume);
 
 /*
- * Plays a music from a createAudio object (clones), only 1 at a time plays
+ * Plays a music from a createAudio object on a voice from the preallocated pool, nothing is allocated
  * Advantage to this method is no more disk reads, only once, data is stored and constantly reused
  *
  * @param audio         Audio object to clone and use
@@ -115,6 +125,43 @@ void playSoundFromMemory(Audio * audio, uint8_t volume);
  */
 void playMusicFromMemory(Audio * audio, uint8_t volume);
 
+/*
+ * Load WAVE files into the sound bank, call once after initAudio
+ * Every clip is converted to the format, channels and frequency the device was opened with and stored in one block of memory
+ *
+ * @param filenames     Filenames of the WAVE files to load
+ * @param count         Number of filenames
+ * @param handles       Receives a handle per filename, AUDIO_NO_SOUND for files that failed
+ *
+ * @return number of clips loaded
+ *
+ */
+int loadSoundBank(const char * const * filenames, int count, SoundHandle * handles);
+
+/*
+ * Plays a sound from the sound bank, nothing is loaded, converted or allocated
+ *
+ * @param sound         Handle from loadSoundBank
+ * @param volume        Volume read playSound for moree
+ *
+ */
+void playSoundFromBank(SoundHandle sound, uint8_t volume);
+
+/*
+ * Plays a music from the sound bank, only 1 at a time plays
+ *
+ * @param sound         Handle from loadSoundBank
+ * @param volume        Volume read playSound for moree
+ *
+ */
+void playMusicFromBank(SoundHandle sound, uint8_t volume);
+
+/*
+ * Stop every sound and music playing, takes effect at the start of the next audio buffer
+ *
+ */
+void stopAudio(void);
+
 /*
  * Free all audio related variables
  * Note, this needs to be run even if initAudio fails, because it frees the global audio device
@@ -122,11 +169,17 @@ void playMusicFromMemory(Audio * audio, uint8_t volume);
  */
 void endAudio(void);
 
+/* Pass as samples to initAudio to use the smallest buffer the device keeps up with */
+#define AUDIO_SAMPLES_AUTO 0
+
 /*
  * Initialize Audio Variable
  *
+ * @param samples           Buffer size in samples, a power of 2, or AUDIO_SAMPLES_AUTO
+ * @param measureLatency    1 to time each sound from play call to first mix, printed by endAudio
+ *
  */
-void initAudio(void);
+void initAudio(uint16_t samples, uint8_t measureLatency);
 
 /*
  * Pause audio from playing
@@ -0,0 +1,239 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "tetris.h"
+#include "batch.h"
+
+struct Random_Policy
+{
+    Random_State random;
+    uint16_t keys;
+};
+
+static void *random_policy_create(uint32_t seed, const void *params)
+{
+    (void)params;
+    Random_Policy *policy = new Random_Policy();
+    random_seed(&policy->random, seed);
+    return policy;
+}
+
+static void random_policy_destroy(void *context)
+{
+    delete (Random_Policy *)context;
+}
+
+static uint16_t random_policy_next_keys(void *context, const Game_State *game)
+{
+    (void)game;
+    const uint16_t KEYS[] = {
+        INPUT_KEY_A,
+        INPUT_KEY_D,
+        INPUT_KEY_LEFT,
+        INPUT_KEY_RIGHT,
+        INPUT_KEY_S,
+        INPUT_KEY_SPACE,
+        0,
+        0
+    };
+
+    Random_Policy *policy = (Random_Policy *)context;
+    if (policy->keys)
+    {
+        policy->keys = 0;
+        return INPUT_KEY_RELEASED;
+    }
+    policy->keys = KEYS[random_int(&policy->random, 0, ARRAY_COUNT(KEYS))];
+    return policy->keys;
+}
+
+const Batch_Policy BATCH_POLICY_RANDOM = {
+    "random",
+    random_policy_create,
+    random_policy_destroy,
+    random_policy_next_keys
+};
+
+static uint32_t batch_game_seed(uint32_t seed, uint32_t index)
+{
+    uint32_t hash = seed + index * 0x9E3779B9u;
+    hash = (hash ^ (hash >> 16)) * 0x85EBCA6Bu;
+    hash = (hash ^ (hash >> 13)) * 0xC2B2AE35u;
+    return hash ^ (hash >> 16);
+}
+
+Batch_Game_Result run_batch_game(const Batch_Config *config, uint32_t seed)
+{
+    Game_State game = {};
+    Input_State input = {};
+
+    game.seed = seed;
+    game.start_level = config->start_level;
+    start_game(&game);
+
+    void *context = config->policy->create(seed, config->policy_params);
+    uint64_t tick = 1;
+    while (game.phase != GAME_PHASE_GAMEOVER && tick <= config->max_ticks)
+    {
+        update_input(&input, config->policy->next_keys(context, &game));
+        update_game(&game, &input, get_tick_time(tick));
+        ++tick;
+    }
+    config->policy->destroy(context);
+
+    Batch_Game_Result result = {};
+    result.seed = seed;
+    result.score = game.score;
+    result.line_count = game.line_count;
+    result.level = game.level;
+    result.piece_count = game.piece_count;
+    result.ticks = tick - 1;
+    return result;
+}
+
+// Work stealing over index ranges. Each worker owns [begin, end) packed into
+// one atomic, pops from the front and, once empty, steals the back half of
+// another worker's range.
+struct alignas(64) Batch_Worker
+{
+    std::atomic<uint64_t> range;
+};
+
+static uint64_t pack_range(uint32_t begin, uint32_t end)
+{
+    return ((uint64_t)end << 32) | begin;
+}
+
+static bool pop_game(Batch_Worker *worker, uint32_t *index)
+{
+    uint64_t range = worker->range.load(std::memory_order_acquire);
+    for (;;)
+    {
+        uint32_t begin = (uint32_t)range;
+        uint32_t end = (uint32_t)(range >> 32);
+        if (begin >= end)
+        {
+            return false;
+        }
+        if (worker->range.compare_exchange_weak(range,
+                                                pack_range(begin + 1, end)))
+        {
+            *index = begin;
+            return true;
+        }
+    }
+}
+
+static bool steal_games(Batch_Worker *workers, uint32_t worker_count,
+                        uint32_t self)
+{
+    for (uint32_t i = 1; i < worker_count; ++i)
+    {
+        Batch_Worker *victim = &workers[(self + i) % worker_count];
+        uint64_t range = victim->range.load(std::memory_order_acquire);
+        for (;;)
+        {
+            uint32_t begin = (uint32_t)range;
+            uint32_t end = (uint32_t)(range >> 32);
+            if (begin >= end)
+            {
+                break;
+            }
+            uint32_t middle = begin + (end - begin) / 2;
+            if (victim->range.compare_exchange_weak(range,
+                                                    pack_range(begin, middle)))
+            {
+                workers[self].range.store(pack_range(middle, end),
+                                          std::memory_order_release);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static void batch_worker(const Batch_Config *config, Batch_Worker *workers,
+                         uint32_t worker_count, uint32_t self,
+                         Batch_Game_Result *results)
+{
+    for (;;)
+    {
+        uint32_t index;
+        while (pop_game(&workers[self], &index))
+        {
+            results[index] = run_batch_game(
+                config, batch_game_seed(config->seed, index));
+        }
+        if (!steal_games(workers, worker_count, self))
+        {
+            return;
+        }
+    }
+}
+
+void run_batch(const Batch_Config *config, Batch_Report *report)
+{
+    uint32_t game_count = config->game_count;
+    uint32_t worker_count = config->thread_count;
+    if (worker_count == 0)
+    {
+        worker_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    *report = {};
+    report->games.resize(game_count);
+
+    std::vector<Batch_Worker> workers(worker_count);
+    for (uint32_t i = 0; i < worker_count; ++i)
+    {
+        uint32_t begin = (uint32_t)((uint64_t)game_count * i / worker_count);
+        uint32_t end = (uint32_t)((uint64_t)game_count * (i + 1) /
+                                  worker_count);
+        workers[i].range.store(pack_range(begin, end));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (uint32_t i = 1; i < worker_count; ++i)
+    {
+        threads.emplace_back(batch_worker, config, workers.data(),
+                             worker_count, i, report->games.data());
+    }
+    batch_worker(config, workers.data(), worker_count, 0,
+                 report->games.data());
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    auto end = std::chrono::steady_clock::now();
+    report->seconds = std::chrono::duration<double>(end - start).count();
+
+    if (game_count == 0)
+    {
+        return;
+    }
+
+    std::vector<int32_t> scores;
+    scores.reserve(game_count);
+    double score_sum = 0;
+    for (const Batch_Game_Result &game : report->games)
+    {
+        report->total_ticks += game.ticks;
+        report->total_pieces += game.piece_count;
+        report->total_lines += game.line_count;
+        score_sum += game.score;
+        scores.push_back(game.score);
+    }
+    std::sort(scores.begin(), scores.end());
+
+    report->score_min = scores.front();
+    report->score_max = scores.back();
+    report->score_mean = score_sum / game_count;
+    report->score_p50 = scores[(game_count - 1) * 50 / 100];
+    report->score_p90 = scores[(game_count - 1) * 90 / 100];
+    report->score_p99 = scores[(game_count - 1) * 99 / 100];
+}
@@ -0,0 +1,65 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <cstdint>
+#include <vector>
+
+#include "tetris.h"
+
+// Plays many independent games across threads, each game with its own seed.
+
+// Produces the raw key mask for each tick of one game. create is called once
+// per game on the thread that plays it, params comes from the batch config
+// and may be null.
+struct Batch_Policy
+{
+    const char *name;
+    void *(*create)(uint32_t seed, const void *params);
+    void (*destroy)(void *context);
+    uint16_t (*next_keys)(void *context, const Game_State *game);
+};
+
+struct Batch_Config
+{
+    uint32_t game_count;
+    uint32_t thread_count;
+    uint32_t seed;
+    int32_t start_level;
+    // Games still running after this many ticks are stopped.
+    uint64_t max_ticks;
+    const Batch_Policy *policy;
+    const void *policy_params;
+};
+
+struct Batch_Game_Result
+{
+    uint32_t seed;
+    int32_t score;
+    int32_t line_count;
+    int32_t level;
+    int32_t piece_count;
+    uint64_t ticks;
+};
+
+struct Batch_Report
+{
+    std::vector<Batch_Game_Result> games;
+    double seconds;
+    uint64_t total_ticks;
+    uint64_t total_pieces;
+    uint64_t total_lines;
+    int32_t score_min;
+    int32_t score_max;
+    double score_mean;
+    int32_t score_p50;
+    int32_t score_p90;
+    int32_t score_p99;
+};
+
+// Presses random movement keys, never pauses.
+extern const Batch_Policy BATCH_POLICY_RANDOM;
+
+Batch_Game_Result run_batch_game(const Batch_Config *config, uint32_t seed);
+void run_batch(const Batch_Config *config, Batch_Report *report);
+
+#endif
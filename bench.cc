@@ -0,0 +1,814 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "tetris.h"
+#include "row_kernels.h"
+#include "mixer.h"
+#include "replay.h"
+#include "ai.h"
+
+// Microbenchmarks of the core kernels. Each one is timed over a batch of ops
+// grown until it runs for at least the minimum time, the fastest of several
+// batches is reported in ns/op as JSON on stdout. All inputs come from fixed
+// seeds so runs on the same build and machine compare directly.
+//
+// Boards are synthetic (empty and randomly filled) for every geometry, plus
+// snapshots taken at each spawn of a recorded AI game and of any replays
+// given on the command line. The mixer runs on random voices.
+
+#define BENCH_RUNS 5
+#define BENCH_SEED 1
+#define BENCH_TRACE_TICKS 20000
+#define BENCH_KEY_COUNT 4096
+#define BENCH_MIX_SAMPLES 1024
+#define BENCH_MIX_VOICES 16
+
+struct Bench_Options
+{
+    const char *filter;
+    double min_seconds;
+};
+
+struct Bench_Result
+{
+    std::string name;
+    std::string board;
+    double ns_per_op;
+    uint64_t ops;
+};
+
+std::vector<Bench_Result> bench_results;
+uint64_t bench_sink;
+
+template <typename F>
+static double time_run(F run, uint64_t ops)
+{
+    auto start = std::chrono::steady_clock::now();
+    bench_sink += run(ops);
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+// run(ops) does ops operations and returns something derived from their
+// results so the compiler cannot drop them.
+template <typename F>
+static void bench(const Bench_Options *options, const std::string &name,
+                  const std::string &board, F run, double baseline_ns = 0)
+{
+    if (options->filter && name.find(options->filter) == std::string::npos)
+    {
+        return;
+    }
+
+    uint64_t ops = 16;
+    double seconds = time_run(run, ops);
+    while (seconds < options->min_seconds)
+    {
+        ops *= 2;
+        seconds = time_run(run, ops);
+    }
+    for (int32_t i = 1; i < BENCH_RUNS; ++i)
+    {
+        double run_seconds = time_run(run, ops);
+        seconds = run_seconds < seconds ? run_seconds : seconds;
+    }
+
+    Bench_Result result;
+    result.name = name;
+    result.board = board;
+    result.ns_per_op = seconds * 1e9 / ops - baseline_ns;
+    result.ops = ops;
+    bench_results.push_back(result);
+}
+
+static double last_ns_per_op()
+{
+    return bench_results.empty() ? 0 : bench_results.back().ns_per_op;
+}
+
+template <typename G>
+static std::string geometry_name()
+{
+    return std::to_string(G::width) + "x" + std::to_string(G::height);
+}
+
+// Game states with the current piece resting where it lands, right before
+// merge_piece, and the same states after the lock.
+template <typename G>
+struct Bench_Boards
+{
+    std::string name;
+    std::vector<Basic_Game_State<G>> states;
+    std::vector<Basic_Game_State<G>> merged;
+    // Merged states with full rows marked in lines.
+    std::vector<Basic_Game_State<G>> clears;
+};
+
+template <typename G>
+static void add_board(Bench_Boards<G> *boards,
+                      const Basic_Game_State<G> *game)
+{
+    Basic_Game_State<G> state = *game;
+    if (state.phase != GAME_PHASE_PLAY ||
+        !check_piece_valid<G>(&state.piece, state.bitboard))
+    {
+        return;
+    }
+    state.piece.offset_row += get_drop_distance(&state, &state.piece);
+    boards->states.push_back(state);
+
+    state.locked_rows = 0;
+    merge_piece(&state);
+    state.pending_line_count = find_lines(state.row_fills, G::width,
+                                          G::height, state.locked_rows,
+                                          state.lines);
+    boards->merged.push_back(state);
+    if (state.pending_line_count > 0)
+    {
+        boards->clears.push_back(state);
+    }
+}
+
+// Rebuilds heights and holes after the board was written directly.
+template <typename G>
+static void refresh_board(Basic_Game_State<G> *game)
+{
+    memset(game->lines, 0, sizeof(game->lines));
+    clear_lines(game);
+}
+
+template <typename G>
+static void set_cell(Basic_Game_State<G> *game, int32_t row, int32_t col,
+                     uint8_t value)
+{
+    matrix_set(game->board, G::width, row, col, value);
+    game->bitboard[row] |= (typename G::Row)(1u << col);
+    ++game->row_fills[row];
+}
+
+template <typename G>
+static void make_synthetic_boards(Bench_Boards<G> *boards, bool empty)
+{
+    boards->name = geometry_name<G>() + (empty ? "/empty" : "/random");
+
+    Random_State random;
+    random_seed(&random, BENCH_SEED);
+    for (int32_t i = 0; i < 256; ++i)
+    {
+        Basic_Game_State<G> game = {};
+        game.seed = random_next(&random);
+        start_game(&game);
+
+        // Stacks up to half the board with one gap per row, then makes a
+        // few of the rows full for the clear benchmark.
+        int32_t stack_height = empty ? 0 : random_int(&random, 1,
+                                                      G::height / 2);
+        int32_t full_count = empty ? 0 : random_int(&random, 1, 5);
+        for (int32_t row = G::height - stack_height; row < G::height; ++row)
+        {
+            int32_t gap = random_int(&random, 0, G::width);
+            bool full = G::height - row <= full_count;
+            for (int32_t col = 0; col < G::width; ++col)
+            {
+                if (full || (col != gap && random_int(&random, 0, 10) < 7))
+                {
+                    set_cell(&game, row, col,
+                             (uint8_t)random_int(&random, 1, 8));
+                }
+            }
+        }
+        refresh_board(&game);
+
+        if (full_count > 0)
+        {
+            Basic_Game_State<G> clear = game;
+            clear.pending_line_count = find_lines(clear.row_fills, G::width,
+                                                  G::height, G::all_rows,
+                                                  clear.lines);
+            boards->clears.push_back(clear);
+
+            // The other benchmarks get a board without full rows.
+            memcpy(game.lines, clear.lines, sizeof(game.lines));
+            clear_lines(&game);
+        }
+
+        // Any spot the piece fits in at the top, else where it spawned.
+        for (int32_t attempt = 0; attempt < 8; ++attempt)
+        {
+            Piece_State piece = game.piece;
+            piece.rotation = random_int(&random, 0, 4);
+            piece.offset_col = random_int(&random, -2, G::width);
+            if (check_piece_valid<G>(&piece, game.bitboard))
+            {
+                game.piece = piece;
+                break;
+            }
+        }
+        add_board(boards, &game);
+    }
+}
+
+// Plays a replay, keeping a board at every spawn.
+static void make_replay_boards(Bench_Boards<Default_Geometry> *boards,
+                               const Replay *replay, const std::string &name)
+{
+    boards->name = geometry_name<Default_Geometry>() + "/" + name;
+
+    Game_State game = {};
+    Input_State input = {};
+    Replay_Player player = {};
+    uint64_t tick = replay_start(&player, replay, &game, &input);
+    int32_t piece_count = -1;
+    uint16_t keys;
+    while (replay_next_keys(&player, &keys))
+    {
+        if (game.piece_count != piece_count)
+        {
+            add_board(boards, &game);
+            piece_count = game.piece_count;
+        }
+        update_input(&input, keys);
+        update_game(&game, &input, get_tick_time(tick));
+        ++tick;
+    }
+}
+
+// Records a game played by the placement search as a replay.
+static void record_ai_game(Replay *replay)
+{
+    Game_State game = {};
+    Input_State input = {};
+    Ai_Player player;
+    ai_player_init(&player, &AI_DEFAULT_CONFIG, 0);
+
+    game.seed = BENCH_SEED;
+    start_game(&game);
+    replay_begin(replay, &game, &input, BENCH_SEED, 0);
+    for (uint64_t tick = 1; tick <= BENCH_TRACE_TICKS &&
+                            game.phase != GAME_PHASE_GAMEOVER; ++tick)
+    {
+        uint16_t keys = ai_player_next_keys(&player, &game);
+        replay_record(replay, keys);
+        update_input(&input, keys);
+        update_game(&game, &input, get_tick_time(tick));
+    }
+}
+
+template <typename G>
+static void bench_boards(const Bench_Options *options,
+                         const Bench_Boards<G> *boards)
+{
+    const std::string &name = boards->name;
+    if (boards->states.empty())
+    {
+        return;
+    }
+
+    // Landing spot, one row up, one row into the stack, one column either
+    // side and a turn: a mix of valid and invalid positions.
+    struct Probe
+    {
+        const typename G::Row *bitboard;
+        Piece_State piece;
+    };
+    std::vector<Probe> probes;
+    for (const Basic_Game_State<G> &state : boards->states)
+    {
+        const int32_t OFFSETS[][3] = {
+            { 0, 0, 0 }, { -1, 0, 0 }, { 1, 0, 0 },
+            { 0, -1, 0 }, { 0, 1, 0 }, { 0, 0, 1 }
+        };
+        for (uint32_t i = 0; i < ARRAY_COUNT(OFFSETS); ++i)
+        {
+            Probe probe = { state.bitboard, state.piece };
+            probe.piece.offset_row += OFFSETS[i][0];
+            probe.piece.offset_col += OFFSETS[i][1];
+            probe.piece.rotation = (probe.piece.rotation + OFFSETS[i][2]) % 4;
+            probes.push_back(probe);
+        }
+    }
+    bench(options, "check_piece_valid", name, [&](uint64_t ops)
+    {
+        uint64_t valid = 0;
+        for (uint64_t i = 0; i < ops; ++i)
+        {
+            const Probe &probe = probes[i % probes.size()];
+            valid += check_piece_valid<G>(&probe.piece, probe.bitboard);
+        }
+        return valid;
+    });
+
+    // merge_piece and clear_lines change the state, so every op restores a
+    // copy first. The copy alone is measured and subtracted.
+    const std::vector<Basic_Game_State<G>> &states = boards->states;
+    Basic_Game_State<G> game;
+    bench(options, "game_state_copy", name, [&](uint64_t ops)
+    {
+        uint64_t sum = 0;
+        for (uint64_t i = 0; i < ops; ++i)
+        {
+            memcpy(&game, &states[i % states.size()], sizeof(game));
+            sum += game.piece_count;
+        }
+        return sum;
+    });
+    double copy_ns = last_ns_per_op();
+
+    bench(options, "merge_piece", name, [&](uint64_t ops)
+    {
+        uint64_t sum = 0;
+        for (uint64_t i = 0; i < ops; ++i)
+        {
+            memcpy(&game, &states[i % states.size()], sizeof(game));
+            merge_piece(&game);
+            sum += game.hole_count;
+        }
+        return sum;
+    }, copy_ns);
+
+    const std::vector<Basic_Game_State<G>> &merged = boards->merged;
+    uint8_t lines[G::height];
+    bench(options, "find_lines", name, [&](uint64_t ops)
+    {
+        uint64_t sum = 0;
+        for (uint64_t i = 0; i < ops; ++i)
+        {
+            const Basic_Game_State<G> &state = merged[i % merged.size()];
+            sum += find_lines(state.row_fills, G::width, G::height,
+                              state.locked_rows, lines);
+        }
+        return sum;
+    });
+
+    const std::vector<Basic_Game_State<G>> &clears = boards->clears;
+    if (!clears.empty())
+    {
+        bench(options, "clear_lines", name, [&](uint64_t ops)
+        {
+            uint64_t sum = 0;
+            for (uint64_t i = 0; i < ops; ++i)
+            {
+                memcpy(&game, &clears[i % clears.size()], sizeof(game));
+                clear_lines(&game);
+                sum += game.hole_count;
+            }
+            return sum;
+        }, copy_ns);
+    }
+}
+
+// Ticks of a game fed fixed random keys, which restarts itself after game
+// over since the keys include space.
+template <typename G>
+static void bench_random_ticks(const Bench_Options *options)
+{
+    std::vector<uint16_t> keys(BENCH_KEY_COUNT);
+    Random_State random;
+    random_seed(&random, BENCH_SEED);
+    for (uint16_t &key : keys)
+    {
+        key = (uint16_t)(random_next(&random) &
+                         (INPUT_KEY_A | INPUT_KEY_D | INPUT_KEY_S |
+                          INPUT_KEY_LEFT | INPUT_KEY_RIGHT | INPUT_KEY_SPACE));
+        if (random_int(&random, 0, 2))
+        {
+            key = INPUT_KEY_RELEASED;
+        }
+    }
+
+    Basic_Game_State<G> game = {};
+    Input_State input = {};
+    game.seed = BENCH_SEED;
+    start_game(&game);
+    uint64_t tick = 1;
+    bench(options, "update_game", geometry_name<G>() + "/random_keys",
+          [&](uint64_t ops)
+    {
+        for (uint64_t i = 0; i < ops; ++i)
+        {
+            update_input(&input, keys[tick % keys.size()]);
+            update_game(&game, &input, get_tick_time(tick));
+            ++tick;
+        }
+        return (uint64_t)game.score;
+    });
+}
+
+static void bench_replay_ticks(const Bench_Options *options,
+                               const Replay *replay, const std::string &name)
+{
+    if (replay->tick_count == 0)
+    {
+        return;
+    }
+
+    bench(options, "update_game", geometry_name<Default_Geometry>() + "/" +
+          name, [&](uint64_t ops)
+    {
+        uint64_t sum = 0;
+        uint64_t done = 0;
+        while (done < ops)
+        {
+            Game_State game = {};
+            Input_State input = {};
+            Replay_Player player = {};
+            uint64_t tick = replay_start(&player, replay, &game, &input);
+            uint16_t keys;
+            while (done < ops && replay_next_keys(&player, &keys))
+            {
+                update_input(&input, keys);
+                update_game(&game, &input, get_tick_time(tick));
+                ++tick;
+                ++done;
+            }
+            sum += game.score;
+        }
+        return sum;
+    });
+}
+
+template <typename G>
+static void bench_geometry(const Bench_Options *options)
+{
+    for (int32_t empty = 1; empty >= 0; --empty)
+    {
+        Bench_Boards<G> boards;
+        make_synthetic_boards(&boards, empty != 0);
+        bench_boards(options, &boards);
+    }
+    bench_random_ticks<G>(options);
+}
+
+static void bench_replay(const Bench_Options *options, const Replay *replay,
+                         const std::string &name)
+{
+    Bench_Boards<Default_Geometry> boards;
+    make_replay_boards(&boards, replay, name);
+    bench_boards(options, &boards);
+    bench_replay_ticks(options, replay, name);
+}
+
+// Same inputs through the vector and plain loop versions.
+template <typename G>
+static void bench_row_kernels(const Bench_Options *options)
+{
+    std::string name = geometry_name<G>();
+    uint8_t fills[G::height];
+    uint8_t board[G::width * G::height] = {};
+    uint64_t masks[64];
+
+    Random_State random;
+    random_seed(&random, BENCH_SEED);
+    for (int32_t row = 0; row < G::height; ++row)
+    {
+        fills[row] = (uint8_t)random_int(&random, G::width - 2,
+                                         G::width + 1);
+    }
+    for (uint32_t i = 0; i < ARRAY_COUNT(masks); ++i)
+    {
+        // One to four cleared rows in the lower half, as after a lock.
+        masks[i] = 0;
+        int32_t count = random_int(&random, 1, 5);
+        for (int32_t j = 0; j < count; ++j)
+        {
+            masks[i] |= 1ull << random_int(&random, G::height / 2, G::height);
+        }
+    }
+
+    bench(options, "match_rows", name, [&](uint64_t ops)
+    {
+        uint64_t sum = 0;
+        for (uint64_t i = 0; i < ops; ++i)
+        {
+            fills[i % G::height] ^= 1;
+            sum += match_rows(fills, G::height, G::width);
+        }
+        return sum;
+    });
+    bench(options, "match_rows_scalar", name, [&](uint64_t ops)
+    {
+        uint64_t sum = 0;
+        for (uint64_t i = 0; i < ops; ++i)
+        {
+            fills[i % G::height] ^= 1;
+            sum += match_rows_scalar(fills, G::height, G::width);
+        }
+        return sum;
+    });
+    bench(options, "compact_rows", name, [&](uint64_t ops)
+    {
+        for (uint64_t i = 0; i < ops; ++i)
+        {
+            compact_rows(board, G::width, G::height,
+                         masks[i % ARRAY_COUNT(masks)]);
+        }
+        return (uint64_t)board[0];
+    });
+    bench(options, "compact_rows_scalar", name, [&](uint64_t ops)
+    {
+        for (uint64_t i = 0; i < ops; ++i)
+        {
+            compact_rows_scalar(board, G::width, G::height,
+                                masks[i % ARRAY_COUNT(masks)]);
+        }
+        return (uint64_t)board[0];
+    });
+}
+
+static void bench_tables(const Bench_Options *options)
+{
+    struct Get_Args
+    {
+        uint8_t index;
+        int32_t row;
+        int32_t col;
+        int32_t rotation;
+    };
+    std::vector<Get_Args> get_args;
+    for (uint8_t index = 0; index < ARRAY_COUNT(TETROMINOS); ++index)
+    {
+        int32_t side = TETROMINOS[index].side;
+        for (int32_t rotation = 0; rotation < 4; ++rotation)
+        {
+            for (int32_t cell = 0; cell < side * side; ++cell)
+            {
+                get_args.push_back({ index, cell / side, cell % side,
+                                     rotation });
+            }
+        }
+    }
+    bench(options, "tetromino_get", "-", [&](uint64_t ops)
+    {
+        uint64_t sum = 0;
+        for (uint64_t i = 0; i < ops; ++i)
+        {
+            const Get_Args &args = get_args[i % get_args.size()];
+            sum += tetromino_get(TETROMINOS + args.index, args.row,
+                                 args.col, args.rotation);
+        }
+        return sum;
+    });
+
+    int32_t levels[64];
+    int32_t line_counts[64];
+    Random_State random;
+    random_seed(&random, BENCH_SEED);
+    for (uint32_t i = 0; i < ARRAY_COUNT(levels); ++i)
+    {
+        levels[i] = random_int(&random, 0, 30);
+        line_counts[i] = random_int(&random, 0, 5);
+    }
+    bench(options, "compute_score", "-", [&](uint64_t ops)
+    {
+        uint64_t sum = 0;
+        for (uint64_t i = 0; i < ops; ++i)
+        {
+            sum += compute_score(levels[i % ARRAY_COUNT(levels)],
+                                 line_counts[i % ARRAY_COUNT(line_counts)]);
+        }
+        return sum;
+    });
+}
+
+// Mixing each voice straight into the 16 bit stream with a clamp, as one
+// SDL_MixAudioFormat call per voice does.
+static void mix_clamped(int16_t *stream, const int16_t *samples, int32_t count,
+                        int32_t gain)
+{
+    for (int32_t i = 0; i < count; ++i)
+    {
+        int32_t value = stream[i] + samples[i] * gain / MIXER_MAX_GAIN;
+        value = value < -32768 ? -32768 : value;
+        value = value > 32767 ? 32767 : value;
+        stream[i] = (int16_t)value;
+    }
+}
+
+static void bench_mixer(const Bench_Options *options)
+{
+    std::string name = std::to_string(BENCH_MIX_SAMPLES) + " samples";
+    std::vector<int16_t> voices(BENCH_MIX_VOICES * BENCH_MIX_SAMPLES);
+    std::vector<int32_t> mix(BENCH_MIX_SAMPLES);
+    std::vector<int16_t> output(BENCH_MIX_SAMPLES);
+
+    Random_State random;
+    random_seed(&random, BENCH_SEED);
+    for (size_t i = 0; i < voices.size(); ++i)
+    {
+        voices[i] = (int16_t)random_int(&random, -32768, 32768);
+    }
+
+    // One op adds one voice to the buffer, the cost per voice per buffer.
+    // The sum is cleared often enough that it cannot overflow.
+    auto add = [&](void (*add_voice)(int32_t *, const int16_t *, int32_t,
+                                     int32_t))
+    {
+        return [&, add_voice](uint64_t ops)
+        {
+            for (uint64_t i = 0; i < ops; ++i)
+            {
+                if (i % 256 == 0)
+                {
+                    mixer_clear(mix.data(), BENCH_MIX_SAMPLES);
+                }
+                const int16_t *voice = voices.data() +
+                    i % BENCH_MIX_VOICES * BENCH_MIX_SAMPLES;
+                add_voice(mix.data(), voice, BENCH_MIX_SAMPLES,
+                          MIXER_MAX_GAIN / 2);
+            }
+            return (uint64_t)mix[0];
+        };
+    };
+    bench(options, "mixer_add", name, add(mixer_add));
+    bench(options, "mixer_add_scalar", name, add(mixer_add_scalar));
+    bench(options, "mix_clamped", name, [&](uint64_t ops)
+    {
+        for (uint64_t i = 0; i < ops; ++i)
+        {
+            const int16_t *voice = voices.data() +
+                i % BENCH_MIX_VOICES * BENCH_MIX_SAMPLES;
+            mix_clamped(output.data(), voice, BENCH_MIX_SAMPLES,
+                        MIXER_MAX_GAIN / 2);
+        }
+        return (uint64_t)output[0];
+    });
+
+    // One op limits and converts a whole buffer of four loud voices.
+    mixer_clear(mix.data(), BENCH_MIX_SAMPLES);
+    for (int32_t voice = 0; voice < 4; ++voice)
+    {
+        mixer_add(mix.data(), voices.data() + voice * BENCH_MIX_SAMPLES,
+                  BENCH_MIX_SAMPLES, MIXER_MAX_GAIN);
+    }
+    auto convert = [&](void (*output_mix)(const int32_t *, int16_t *, int32_t,
+                                          Mixer_Limiter *))
+    {
+        return [&, output_mix](uint64_t ops)
+        {
+            Mixer_Limiter limiter;
+            mixer_limiter_init(&limiter, 2205);
+            for (uint64_t i = 0; i < ops; ++i)
+            {
+                output_mix(mix.data(), output.data(), BENCH_MIX_SAMPLES,
+                           &limiter);
+            }
+            return (uint64_t)output[0];
+        };
+    };
+    bench(options, "mixer_output", name, convert(mixer_output));
+    bench(options, "mixer_output_scalar", name, convert(mixer_output_scalar));
+
+    // One op is a whole callback's work for a number of voices.
+    const int32_t VOICE_COUNTS[] = { 1, 4, 16 };
+    for (uint32_t i = 0; i < ARRAY_COUNT(VOICE_COUNTS); ++i)
+    {
+        int32_t voice_count = VOICE_COUNTS[i];
+        bench(options, "mixer_buffer",
+              std::to_string(voice_count) + " voices x " + name,
+              [&, voice_count](uint64_t ops)
+        {
+            Mixer_Limiter limiter;
+            mixer_limiter_init(&limiter, 2205);
+            for (uint64_t op = 0; op < ops; ++op)
+            {
+                mixer_clear(mix.data(), BENCH_MIX_SAMPLES);
+                for (int32_t voice = 0; voice < voice_count; ++voice)
+                {
+                    mixer_add(mix.data(),
+                              voices.data() + voice * BENCH_MIX_SAMPLES,
+                              BENCH_MIX_SAMPLES, MIXER_MAX_GAIN / 2);
+                }
+                mixer_output(mix.data(), output.data(), BENCH_MIX_SAMPLES,
+                             &limiter);
+            }
+            return (uint64_t)output[0];
+        });
+    }
+}
+
+// Board names include replay file names, which can hold any character.
+static std::string json_escape(const std::string &text)
+{
+    std::string escaped;
+    for (size_t i = 0; i < text.size(); ++i)
+    {
+        unsigned char c = (unsigned char)text[i];
+        if (c == '"' || c == '\\')
+        {
+            escaped += '\\';
+            escaped += (char)c;
+        }
+        else if (c < 0x20)
+        {
+            char buffer[8];
+            snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+            escaped += buffer;
+        }
+        else
+        {
+            escaped += (char)c;
+        }
+    }
+    return escaped;
+}
+
+static void print_results()
+{
+    printf("{\n");
+    printf("  \"unit\": \"ns/op\",\n");
+    printf("  \"benchmarks\": [\n");
+    for (size_t i = 0; i < bench_results.size(); ++i)
+    {
+        const Bench_Result &result = bench_results[i];
+        printf("    { \"name\": \"%s\", \"board\": \"%s\", "
+               "\"ns_per_op\": %.3f, \"ops\": %llu }%s\n",
+               json_escape(result.name).c_str(),
+               json_escape(result.board).c_str(), result.ns_per_op,
+               (unsigned long long)result.ops,
+               i + 1 < bench_results.size() ? "," : "");
+    }
+    printf("  ]\n");
+    printf("}\n");
+}
+
+static void print_usage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s [--replay FILE]... [--filter NAME] [--min-ms N]\n",
+            program);
+}
+
+int main(int argc, char **argv)
+{
+    Bench_Options options = {};
+    options.min_seconds = 0.02;
+    std::vector<const char *> replay_filenames;
+
+    for (int32_t i = 1; i < argc; ++i)
+    {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : 0;
+        if (!value)
+        {
+            print_usage(argv[0]);
+            return 1;
+        }
+        ++i;
+
+        if (strcmp(arg, "--replay") == 0)
+        {
+            replay_filenames.push_back(value);
+        }
+        else if (strcmp(arg, "--filter") == 0)
+        {
+            options.filter = value;
+        }
+        else if (strcmp(arg, "--min-ms") == 0)
+        {
+            options.min_seconds = atof(value) / 1000;
+        }
+        else
+        {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<Replay> replays(replay_filenames.size());
+    for (size_t i = 0; i < replays.size(); ++i)
+    {
+        if (!replay_load(&replays[i], replay_filenames[i]))
+        {
+            fprintf(stderr, "Failed to load replay %s\n",
+                    replay_filenames[i]);
+            return 1;
+        }
+    }
+
+    bench_tables(&options);
+    bench_geometry<Default_Geometry>(&options);
+    bench_geometry<Wide_Geometry>(&options);
+
+    Replay ai_replay;
+    record_ai_game(&ai_replay);
+    bench_replay(&options, &ai_replay, "ai");
+    for (size_t i = 0; i < replays.size(); ++i)
+    {
+        std::string name = replay_filenames[i];
+        bench_replay(&options, &replays[i],
+                     name.substr(name.find_last_of("/\\") + 1));
+    }
+
+    bench_row_kernels<Default_Geometry>(&options);
+    bench_row_kernels<Wide_Geometry>(&options);
+    bench_mixer(&options);
+
+    print_results();
+    fprintf(stderr, "sink: %llu\n", (unsigned long long)bench_sink);
+    return 0;
+}
@@ -8,5 +8,5 @@ SET LinkerFlags=-opt:ref SDL2main.lib SDL2.lib SDL2_ttf.lib /LIBPATH:C:\sdl\SDL2
 
 SET IncludeDirectories=/I "C:\sdl\SDL2-2.0.12\include" /I "C:\sdl\SDL2_ttf-2.0.15\include"
 
-cl %CompilerFlags% %IncludeDirectories% tetris.cc audio.cc /link %LinkerFlags%
+cl %CompilerFlags% %IncludeDirectories% tetris.cc frame_stats.cc tetris_core.cc row_kernels.cc replay.cc batch.cc ai.cc audio.cc mixer.cc /link %LinkerFlags%
 
@@ -0,0 +1,139 @@
+#include <cstdint>
+#include <ostream>
+
+#include "frame_stats.h"
+
+const char *FRAME_PHASE_NAMES[FRAME_PHASE_COUNT] = {
+    "input",
+    "update",
+    "render",
+    "present",
+    "frame"
+};
+
+void frame_stats_init(Frame_Stats *stats, uint64_t frequency,
+                      uint64_t counter)
+{
+    *stats = {};
+    stats->frequency = frequency;
+    stats->frame_start = counter;
+    stats->mark = counter;
+}
+
+static uint32_t get_bucket(uint32_t micros)
+{
+    uint32_t bucket = micros / FRAME_HISTOGRAM_BUCKET_US;
+    return bucket < FRAME_HISTOGRAM_BUCKETS ? bucket :
+                                              FRAME_HISTOGRAM_BUCKETS - 1;
+}
+
+static void histogram_add(Frame_Histogram *histogram, uint32_t micros)
+{
+    if (histogram->count == FRAME_STATS_WINDOW)
+    {
+        --histogram->counts[get_bucket(histogram->samples[histogram->next])];
+    }
+    else
+    {
+        ++histogram->count;
+    }
+    histogram->samples[histogram->next] = micros;
+    ++histogram->counts[get_bucket(micros)];
+    histogram->next = (histogram->next + 1) % FRAME_STATS_WINDOW;
+}
+
+static uint32_t get_micros(const Frame_Stats *stats, uint64_t ticks)
+{
+    return (uint32_t)(ticks * 1000000 / stats->frequency);
+}
+
+bool frame_stats_begin_frame(Frame_Stats *stats, uint64_t counter)
+{
+    stats->frame_micros[FRAME_PHASE_FRAME] = get_micros(
+        stats, counter - stats->frame_start);
+    stats->frame_start = counter;
+    stats->mark = counter;
+
+    for (int32_t phase = 0; phase < FRAME_PHASE_COUNT; ++phase)
+    {
+        stats->last_micros[phase] = stats->frame_micros[phase];
+        stats->frame_micros[phase] = 0;
+    }
+
+    // Nothing was timed before the first call.
+    if (stats->frame_count++ == 0)
+    {
+        return false;
+    }
+
+    for (int32_t phase = 0; phase < FRAME_PHASE_COUNT; ++phase)
+    {
+        histogram_add(&stats->phases[phase], stats->last_micros[phase]);
+    }
+    return true;
+}
+
+void frame_stats_mark(Frame_Stats *stats, Frame_Phase phase, uint64_t counter)
+{
+    stats->frame_micros[phase] += get_micros(stats, counter - stats->mark);
+    stats->mark = counter;
+}
+
+void frame_stats_summary(const Frame_Stats *stats, Frame_Phase phase,
+                         Frame_Summary *summary)
+{
+    const Frame_Histogram *histogram = &stats->phases[phase];
+    *summary = {};
+    if (histogram->count == 0)
+    {
+        return;
+    }
+
+    uint32_t max_micros = 0;
+    for (uint32_t i = 0; i < histogram->count; ++i)
+    {
+        if (histogram->samples[i] > max_micros)
+        {
+            max_micros = histogram->samples[i];
+        }
+    }
+    summary->max_ms = max_micros / 1000.f;
+
+    // A bucket's upper bound can be above every sample in it.
+    const float PERCENTS[] = { 0.50f, 0.95f, 0.99f };
+    float *values[] = { &summary->p50_ms, &summary->p95_ms, &summary->p99_ms };
+    uint32_t target = 0;
+    uint32_t seen = 0;
+    for (uint32_t bucket = 0; bucket < FRAME_HISTOGRAM_BUCKETS && target < 3;
+         ++bucket)
+    {
+        seen += histogram->counts[bucket];
+        while (target < 3 && seen >= PERCENTS[target] * histogram->count)
+        {
+            float bound = (bucket + 1) * FRAME_HISTOGRAM_BUCKET_US / 1000.f;
+            *values[target] = bound < summary->max_ms ? bound :
+                                                        summary->max_ms;
+            ++target;
+        }
+    }
+}
+
+void frame_stats_write_csv_header(std::ostream &out)
+{
+    out << "frame";
+    for (int32_t phase = 0; phase < FRAME_PHASE_COUNT; ++phase)
+    {
+        out << "," << FRAME_PHASE_NAMES[phase] << "_us";
+    }
+    out << "\n";
+}
+
+void frame_stats_write_csv_row(const Frame_Stats *stats, std::ostream &out)
+{
+    out << stats->frame_count - 2;
+    for (int32_t phase = 0; phase < FRAME_PHASE_COUNT; ++phase)
+    {
+        out << "," << stats->last_micros[phase];
+    }
+    out << "\n";
+}
@@ -0,0 +1,75 @@
+#ifndef FRAME_STATS_H
+#define FRAME_STATS_H
+
+#include <cstdint>
+#include <ostream>
+
+// Per-phase frame timing from a high resolution counter, kept as a rolling
+// window of the last FRAME_STATS_WINDOW frames with a histogram for
+// percentiles. Finished frames can also be written out as CSV rows.
+
+enum Frame_Phase
+{
+    FRAME_PHASE_INPUT,
+    FRAME_PHASE_UPDATE,
+    FRAME_PHASE_RENDER,
+    FRAME_PHASE_PRESENT,
+    // Start of one frame to the start of the next.
+    FRAME_PHASE_FRAME,
+    FRAME_PHASE_COUNT
+};
+
+extern const char *FRAME_PHASE_NAMES[FRAME_PHASE_COUNT];
+
+#define FRAME_STATS_WINDOW 1024
+// 50 us buckets up to 100 ms, slower samples land in the last bucket.
+#define FRAME_HISTOGRAM_BUCKET_US 50
+#define FRAME_HISTOGRAM_BUCKETS 2000
+
+struct Frame_Histogram
+{
+    uint16_t counts[FRAME_HISTOGRAM_BUCKETS];
+    uint32_t samples[FRAME_STATS_WINDOW];
+    uint32_t next;
+    uint32_t count;
+};
+
+struct Frame_Stats
+{
+    Frame_Histogram phases[FRAME_PHASE_COUNT];
+    // Phases of the frame in progress and of the last finished one.
+    uint32_t frame_micros[FRAME_PHASE_COUNT];
+    uint32_t last_micros[FRAME_PHASE_COUNT];
+    uint64_t frequency;
+    uint64_t frame_start;
+    uint64_t mark;
+    uint64_t frame_count;
+};
+
+struct Frame_Summary
+{
+    float p50_ms;
+    float p95_ms;
+    float p99_ms;
+    float max_ms;
+};
+
+// counter and frequency are SDL_GetPerformanceCounter/Frequency values.
+void frame_stats_init(Frame_Stats *stats, uint64_t frequency,
+                      uint64_t counter);
+
+// Call at the start of every frame, it records the frame before and returns
+// false on the first call when there is none.
+bool frame_stats_begin_frame(Frame_Stats *stats, uint64_t counter);
+// Ends phase, which ran since the frame start or the previous mark.
+void frame_stats_mark(Frame_Stats *stats, Frame_Phase phase, uint64_t counter);
+
+// Percentiles are bucket upper bounds, at most the exact max.
+void frame_stats_summary(const Frame_Stats *stats, Frame_Phase phase,
+                         Frame_Summary *summary);
+
+// One line per frame: frame number and the microseconds of each phase.
+void frame_stats_write_csv_header(std::ostream &out);
+void frame_stats_write_csv_row(const Frame_Stats *stats, std::ostream &out);
+
+#endif
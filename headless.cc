@@ -0,0 +1,226 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "tetris.h"
+#include "replay.h"
+#include "batch.h"
+#include "ai.h"
+
+// Runs the game without SDL as fast as the CPU allows, either playing back
+// a replay or playing a batch of independent games across threads.
+
+const Batch_Policy *BATCH_POLICIES[] = {
+    &BATCH_POLICY_RANDOM,
+    &BATCH_POLICY_AI,
+    &BATCH_POLICY_AI_LOOKAHEAD
+};
+
+struct Replay_Result
+{
+    uint64_t ticks;
+    int32_t score;
+    int32_t line_count;
+    int32_t level;
+    Game_Phase phase;
+};
+
+Replay_Result run_replay(const Replay *replay)
+{
+    Game_State game = {};
+    Input_State input = {};
+    Replay_Player player = {};
+
+    uint64_t tick = replay_start(&player, replay, &game, &input);
+    uint16_t keys;
+    while (replay_next_keys(&player, &keys))
+    {
+        update_input(&input, keys);
+        update_game(&game, &input, get_tick_time(tick));
+        ++tick;
+    }
+
+    Replay_Result result = {};
+    result.ticks = player.tick;
+    result.score = game.score;
+    result.line_count = game.line_count;
+    result.level = game.level;
+    result.phase = game.phase;
+    return result;
+}
+
+int play_replay(const char *replay_filename, int32_t repeat)
+{
+    Replay replay;
+    if (!replay_load(&replay, replay_filename))
+    {
+        fprintf(stderr, "Failed to load replay %s\n", replay_filename);
+        return 1;
+    }
+
+    Replay_Result result = {};
+    auto start = std::chrono::steady_clock::now();
+    for (int32_t i = 0; i < repeat; ++i)
+    {
+        Replay_Result run = run_replay(&replay);
+        if (i > 0 && memcmp(&run, &result, sizeof(run)) != 0)
+        {
+            fprintf(stderr, "Replay diverged on run %d\n", i);
+            return 2;
+        }
+        result = run;
+    }
+    auto end = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(end - start).count();
+
+    printf("ticks: %llu\n", (unsigned long long)result.ticks);
+    printf("score: %d\n", result.score);
+    printf("lines: %d\n", result.line_count);
+    printf("level: %d\n", result.level);
+    printf("game over: %s\n",
+           result.phase == GAME_PHASE_GAMEOVER ? "yes" : "no");
+    printf("ticks/s: %.0f\n", result.ticks * repeat / seconds);
+    return 0;
+}
+
+int play_batch(const Batch_Config *config)
+{
+    Batch_Report report;
+    run_batch(config, &report);
+
+    printf("policy: %s\n", config->policy->name);
+    printf("games: %u\n", config->game_count);
+    printf("seconds: %.3f\n", report.seconds);
+    printf("games/s: %.1f\n", config->game_count / report.seconds);
+    printf("pieces/s: %.0f\n", report.total_pieces / report.seconds);
+    printf("ticks/s: %.0f\n", report.total_ticks / report.seconds);
+    printf("lines mean: %.2f\n",
+           (double)report.total_lines / config->game_count);
+    printf("score min: %d\n", report.score_min);
+    printf("score mean: %.1f\n", report.score_mean);
+    printf("score p50: %d\n", report.score_p50);
+    printf("score p90: %d\n", report.score_p90);
+    printf("score p99: %d\n", report.score_p99);
+    printf("score max: %d\n", report.score_max);
+    return 0;
+}
+
+void print_usage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s --replay FILE [--repeat N]\n"
+            "       %s --batch N [--threads N] [--seed N] [--level N]\n"
+            "          [--max-ticks N] [--policy random|ai|lookahead]\n"
+            "          [--table-bytes N] [--table-policy always|oldest]\n",
+            program, program);
+}
+
+int main(int argc, char **argv)
+{
+    const char *replay_filename = 0;
+    int32_t repeat = 1;
+
+    Batch_Config batch = {};
+    batch.seed = 1;
+    batch.max_ticks = 60 * 60 * 60;
+    batch.policy = &BATCH_POLICY_RANDOM;
+
+    Ai_Table_Config table = AI_DEFAULT_TABLE_CONFIG;
+    batch.policy_params = &table;
+
+    for (int32_t i = 1; i < argc; ++i)
+    {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : 0;
+        if (!value)
+        {
+            print_usage(argv[0]);
+            return 1;
+        }
+        ++i;
+
+        if (strcmp(arg, "--replay") == 0)
+        {
+            replay_filename = value;
+        }
+        else if (strcmp(arg, "--repeat") == 0)
+        {
+            repeat = atoi(value);
+        }
+        else if (strcmp(arg, "--batch") == 0)
+        {
+            batch.game_count = (uint32_t)strtoul(value, 0, 10);
+        }
+        else if (strcmp(arg, "--threads") == 0)
+        {
+            batch.thread_count = (uint32_t)strtoul(value, 0, 10);
+        }
+        else if (strcmp(arg, "--seed") == 0)
+        {
+            batch.seed = (uint32_t)strtoul(value, 0, 10);
+        }
+        else if (strcmp(arg, "--level") == 0)
+        {
+            batch.start_level = atoi(value);
+        }
+        else if (strcmp(arg, "--max-ticks") == 0)
+        {
+            batch.max_ticks = strtoull(value, 0, 10);
+        }
+        else if (strcmp(arg, "--policy") == 0)
+        {
+            batch.policy = 0;
+            for (uint32_t p = 0; p < ARRAY_COUNT(BATCH_POLICIES); ++p)
+            {
+                if (strcmp(value, BATCH_POLICIES[p]->name) == 0)
+                {
+                    batch.policy = BATCH_POLICIES[p];
+                }
+            }
+            if (!batch.policy)
+            {
+                fprintf(stderr, "Unknown policy %s\n", value);
+                return 1;
+            }
+        }
+        else if (strcmp(arg, "--table-bytes") == 0)
+        {
+            table.max_bytes = (size_t)strtoull(value, 0, 10);
+        }
+        else if (strcmp(arg, "--table-policy") == 0)
+        {
+            if (strcmp(value, "always") == 0)
+            {
+                table.policy = AI_TABLE_REPLACE_ALWAYS;
+            }
+            else if (strcmp(value, "oldest") == 0)
+            {
+                table.policy = AI_TABLE_REPLACE_OLDEST;
+            }
+            else
+            {
+                fprintf(stderr, "Unknown table policy %s\n", value);
+                return 1;
+            }
+        }
+        else
+        {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (replay_filename && repeat > 0)
+    {
+        return play_replay(replay_filename, repeat);
+    }
+    if (batch.game_count > 0)
+    {
+        return play_batch(&batch);
+    }
+
+    print_usage(argv[0]);
+    return 1;
+}
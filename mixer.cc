@@ -0,0 +1,211 @@
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include "simd.h"
+#include "mixer.h"
+
+#define MIXER_FULL_SCALE (32767.f * MIXER_MAX_GAIN)
+
+void mixer_limiter_init(Mixer_Limiter *limiter, int32_t release_samples)
+{
+    limiter->gain = 1.f;
+    limiter->release = release_samples > 0 ? 1.f / release_samples : 1.f;
+}
+
+void mixer_clear(int32_t *mix, int32_t count)
+{
+    memset(mix, 0, (size_t)count * sizeof(*mix));
+}
+
+// Gain for each sample of the buffer is start + step * index, already scaled
+// down from voice gain units. Reduction is applied from the first sample so
+// the peak never clips, recovery is spread over the buffer.
+static void get_limiter_ramp(Mixer_Limiter *limiter, float peak, int32_t count,
+                             float *start, float *step)
+{
+    float target = peak > MIXER_FULL_SCALE ? MIXER_FULL_SCALE / peak : 1.f;
+    float begin = limiter->gain < target ? limiter->gain : target;
+    float end = begin + limiter->release * count;
+    end = end < target ? end : target;
+
+    *start = begin / MIXER_MAX_GAIN;
+    *step = count > 0 ? (end - begin) / count / MIXER_MAX_GAIN : 0;
+    limiter->gain = end;
+}
+
+void mixer_add_scalar(int32_t *mix, const int16_t *samples, int32_t count,
+                      int32_t gain)
+{
+    for (int32_t i = 0; i < count; ++i)
+    {
+        mix[i] += samples[i] * gain;
+    }
+}
+
+static void output_scalar(const int32_t *mix, int16_t *output, int32_t begin,
+                          int32_t count, float start, float step)
+{
+    for (int32_t i = begin; i < count; ++i)
+    {
+        int32_t value = (int32_t)lrintf(mix[i] * (start + step * (float)i));
+        value = value < -32768 ? -32768 : value;
+        value = value > 32767 ? 32767 : value;
+        output[i] = (int16_t)value;
+    }
+}
+
+static int32_t get_peak_scalar(const int32_t *mix, int32_t begin,
+                               int32_t count)
+{
+    int32_t peak = 0;
+    for (int32_t i = begin; i < count; ++i)
+    {
+        int32_t value = mix[i] < 0 ? -mix[i] : mix[i];
+        peak = value > peak ? value : peak;
+    }
+    return peak;
+}
+
+void mixer_output_scalar(const int32_t *mix, int16_t *output, int32_t count,
+                         Mixer_Limiter *limiter)
+{
+    float start;
+    float step;
+    get_limiter_ramp(limiter, (float)get_peak_scalar(mix, 0, count), count,
+                     &start, &step);
+    output_scalar(mix, output, 0, count, start, step);
+}
+
+#ifdef TETRIS_SSE2
+
+// Samples are widened to 32 bit lanes and the gain sits in the low half of
+// each lane, so madd multiplies them and adds the high half times zero.
+void mixer_add(int32_t *mix, const int16_t *samples, int32_t count,
+               int32_t gain)
+{
+    int32_t i = 0;
+#ifdef TETRIS_AVX2
+    __m256i wide_gain = _mm256_set1_epi32(gain);
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i wide = _mm256_cvtepi16_epi32(
+            _mm_loadu_si128((const __m128i *)(samples + i)));
+        __m256i sum = _mm256_add_epi32(
+            _mm256_loadu_si256((const __m256i *)(mix + i)),
+            _mm256_madd_epi16(wide, wide_gain));
+        _mm256_storeu_si256((__m256i *)(mix + i), sum);
+    }
+#else
+    __m128i narrow_gain = _mm_set1_epi32(gain);
+    __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i narrow = _mm_loadu_si128((const __m128i *)(samples + i));
+        __m128i low = _mm_madd_epi16(_mm_unpacklo_epi16(narrow, zero),
+                                     narrow_gain);
+        __m128i high = _mm_madd_epi16(_mm_unpackhi_epi16(narrow, zero),
+                                      narrow_gain);
+        _mm_storeu_si128((__m128i *)(mix + i), _mm_add_epi32(
+            _mm_loadu_si128((const __m128i *)(mix + i)), low));
+        _mm_storeu_si128((__m128i *)(mix + i + 4), _mm_add_epi32(
+            _mm_loadu_si128((const __m128i *)(mix + i + 4)), high));
+    }
+#endif
+    mixer_add_scalar(mix + i, samples + i, count - i, gain);
+}
+
+// Float conversion rounds to nearest like lrintf and the pack saturates, so
+// the results match the scalar version.
+void mixer_output(const int32_t *mix, int16_t *output, int32_t count,
+                  Mixer_Limiter *limiter)
+{
+    int32_t vector_count = count & ~3;
+    __m128 sign = _mm_set1_ps(-0.f);
+    __m128 peaks = _mm_setzero_ps();
+    for (int32_t i = 0; i < vector_count; i += 4)
+    {
+        __m128 values = _mm_cvtepi32_ps(
+            _mm_loadu_si128((const __m128i *)(mix + i)));
+        peaks = _mm_max_ps(peaks, _mm_andnot_ps(sign, values));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, peaks);
+    float peak = (float)get_peak_scalar(mix, vector_count, count);
+    for (int32_t lane = 0; lane < 4; ++lane)
+    {
+        peak = lanes[lane] > peak ? lanes[lane] : peak;
+    }
+
+    float start;
+    float step;
+    get_limiter_ramp(limiter, peak, count, &start, &step);
+
+    int32_t i = 0;
+#ifdef TETRIS_AVX2
+    __m256 wide_start = _mm256_set1_ps(start);
+    __m256 wide_step = _mm256_set1_ps(step);
+    __m256 index = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256 eight = _mm256_set1_ps(8);
+    for (; i + 16 <= count; i += 16)
+    {
+        __m256 low_gain = _mm256_add_ps(wide_start,
+                                        _mm256_mul_ps(wide_step, index));
+        index = _mm256_add_ps(index, eight);
+        __m256 high_gain = _mm256_add_ps(wide_start,
+                                         _mm256_mul_ps(wide_step, index));
+        index = _mm256_add_ps(index, eight);
+
+        __m256i low = _mm256_cvtps_epi32(_mm256_mul_ps(
+            _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i *)(mix + i))),
+            low_gain));
+        __m256i high = _mm256_cvtps_epi32(_mm256_mul_ps(
+            _mm256_cvtepi32_ps(
+                _mm256_loadu_si256((const __m256i *)(mix + i + 8))),
+            high_gain));
+        // The pack works within 128 bit lanes, put the quarters back in order.
+        __m256i packed = _mm256_permute4x64_epi64(
+            _mm256_packs_epi32(low, high), 0xD8);
+        _mm256_storeu_si256((__m256i *)(output + i), packed);
+    }
+#endif
+    __m128 narrow_start = _mm_set1_ps(start);
+    __m128 narrow_step = _mm_set1_ps(step);
+    __m128 narrow_index = _mm_setr_ps((float)i, (float)(i + 1),
+                                      (float)(i + 2), (float)(i + 3));
+    __m128 four = _mm_set1_ps(4);
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128 low_gain = _mm_add_ps(narrow_start,
+                                     _mm_mul_ps(narrow_step, narrow_index));
+        narrow_index = _mm_add_ps(narrow_index, four);
+        __m128 high_gain = _mm_add_ps(narrow_start,
+                                      _mm_mul_ps(narrow_step, narrow_index));
+        narrow_index = _mm_add_ps(narrow_index, four);
+
+        __m128i low = _mm_cvtps_epi32(_mm_mul_ps(
+            _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(mix + i))),
+            low_gain));
+        __m128i high = _mm_cvtps_epi32(_mm_mul_ps(
+            _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(mix + i + 4))),
+            high_gain));
+        _mm_storeu_si128((__m128i *)(output + i), _mm_packs_epi32(low, high));
+    }
+    output_scalar(mix, output, i, count, start, step);
+}
+
+#else
+
+void mixer_add(int32_t *mix, const int16_t *samples, int32_t count,
+               int32_t gain)
+{
+    mixer_add_scalar(mix, samples, count, gain);
+}
+
+void mixer_output(const int32_t *mix, int16_t *output, int32_t count,
+                  Mixer_Limiter *limiter)
+{
+    mixer_output_scalar(mix, output, count, limiter);
+}
+
+#endif
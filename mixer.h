@@ -0,0 +1,43 @@
+#ifndef MIXER_H
+#define MIXER_H
+
+#include <cstdint>
+
+// Software mixer for signed 16 bit voices, no SDL dependency. Voices are
+// scaled by their gain and summed into an int32 buffer so overlapping voices
+// never clip each other, then the sum goes through a limiter and is converted
+// to 16 bits once. Uses SSE2 or AVX2 when the compiler targets them and
+// TETRIS_NO_SIMD is not defined.
+
+// Voice gains run from 0 to MIXER_MAX_GAIN, the scale of SDL_MIX_MAXVOLUME.
+#define MIXER_MAX_GAIN 128
+
+struct Mixer_Limiter
+{
+    // Gain at the end of the last buffer, 1 when not limiting.
+    float gain;
+    // Gain recovered per sample once the mix is back under full scale.
+    float release;
+};
+
+// The gain takes release_samples to recover from full reduction.
+void mixer_limiter_init(Mixer_Limiter *limiter, int32_t release_samples);
+
+void mixer_clear(int32_t *mix, int32_t count);
+
+// Adds count samples scaled by gain to the mix.
+void mixer_add(int32_t *mix, const int16_t *samples, int32_t count,
+               int32_t gain);
+
+// Writes the mix as 16 bit samples. A buffer whose peak is over full scale
+// is scaled down as a whole, and the gain ramps back up across later ones.
+void mixer_output(const int32_t *mix, int16_t *output, int32_t count,
+                  Mixer_Limiter *limiter);
+
+// Plain loop versions, always available for testing and benchmarks.
+void mixer_add_scalar(int32_t *mix, const int16_t *samples, int32_t count,
+                      int32_t gain);
+void mixer_output_scalar(const int32_t *mix, int16_t *output, int32_t count,
+                         Mixer_Limiter *limiter);
+
+#endif
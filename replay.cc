@@ -0,0 +1,163 @@
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include "tetris.h"
+#include "replay.h"
+
+void replay_begin(Replay *replay, const Game_State *game,
+                  const Input_State *input, uint32_t seed, uint32_t tick)
+{
+    *replay = {};
+    replay->seed = seed;
+    replay->start_level = game->start_level;
+    replay->start_tick = tick;
+    replay->start_keys = get_input_keys(input);
+    replay->start_key_frame_count = input->key_frame_count;
+    replay->start_key_skip_count = input->key_skip_count;
+}
+
+void replay_record(Replay *replay, uint16_t keys)
+{
+    if (replay->runs.empty() ||
+        replay->runs.back().keys != keys ||
+        replay->runs.back().count == UINT16_MAX)
+    {
+        replay->runs.push_back({ keys, 0 });
+    }
+    ++replay->runs.back().count;
+    ++replay->tick_count;
+}
+
+static void write_u16(std::ofstream &outfile, uint16_t value)
+{
+    uint8_t bytes[2] = { (uint8_t)value, (uint8_t)(value >> 8) };
+    outfile.write((const char *)bytes, sizeof(bytes));
+}
+
+static void write_u32(std::ofstream &outfile, uint32_t value)
+{
+    uint8_t bytes[4] = { (uint8_t)value, (uint8_t)(value >> 8),
+                         (uint8_t)(value >> 16), (uint8_t)(value >> 24) };
+    outfile.write((const char *)bytes, sizeof(bytes));
+}
+
+static uint16_t read_u16(std::ifstream &infile)
+{
+    uint8_t bytes[2] = {};
+    infile.read((char *)bytes, sizeof(bytes));
+    return (uint16_t)(bytes[0] | (bytes[1] << 8));
+}
+
+static uint32_t read_u32(std::ifstream &infile)
+{
+    uint8_t bytes[4] = {};
+    infile.read((char *)bytes, sizeof(bytes));
+    return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) |
+           ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+bool replay_save(const Replay *replay, const char *filename)
+{
+    std::ofstream outfile(filename, std::ios::binary);
+    if (!outfile.good())
+    {
+        return false;
+    }
+
+    outfile.write(REPLAY_MAGIC, 4);
+    write_u32(outfile, REPLAY_VERSION);
+    write_u32(outfile, replay->seed);
+    write_u32(outfile, (uint32_t)replay->start_level);
+    write_u32(outfile, replay->start_tick);
+    write_u16(outfile, replay->start_keys);
+    write_u32(outfile, (uint32_t)replay->start_key_frame_count);
+    write_u32(outfile, (uint32_t)replay->start_key_skip_count);
+    write_u32(outfile, replay->tick_count);
+    write_u32(outfile, (uint32_t)replay->runs.size());
+    for (const Replay_Run &run : replay->runs)
+    {
+        write_u16(outfile, run.keys);
+        write_u16(outfile, run.count);
+    }
+    return outfile.good();
+}
+
+bool replay_load(Replay *replay, const char *filename)
+{
+    std::ifstream infile(filename, std::ios::binary);
+    char magic[4] = {};
+    infile.read(magic, sizeof(magic));
+    if (!infile.good() || memcmp(magic, REPLAY_MAGIC, 4) != 0)
+    {
+        return false;
+    }
+    if (read_u32(infile) != REPLAY_VERSION)
+    {
+        return false;
+    }
+
+    *replay = {};
+    replay->seed = read_u32(infile);
+    replay->start_level = (int32_t)read_u32(infile);
+    replay->start_tick = read_u32(infile);
+    replay->start_keys = read_u16(infile);
+    replay->start_key_frame_count = (int32_t)read_u32(infile);
+    replay->start_key_skip_count = (int32_t)read_u32(infile);
+    uint32_t tick_count = read_u32(infile);
+    uint32_t run_count = read_u32(infile);
+    if (!infile.good())
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < run_count && infile.good(); ++i)
+    {
+        Replay_Run run;
+        run.keys = read_u16(infile);
+        run.count = read_u16(infile);
+        replay->runs.push_back(run);
+        replay->tick_count += run.count;
+    }
+    return infile.good() && replay->tick_count == tick_count;
+}
+
+uint64_t replay_start(Replay_Player *player, const Replay *replay,
+                      Game_State *game, Input_State *input)
+{
+    *player = {};
+    player->replay = replay;
+
+    game->seed = replay->seed;
+    game->start_level = replay->start_level;
+    game->time = get_tick_time(replay->start_tick);
+    start_game(game);
+
+    *input = {};
+    update_input(input, replay->start_keys);
+    input->key_frame_count = replay->start_key_frame_count;
+    input->key_skip_count = replay->start_key_skip_count;
+
+    return (uint64_t)replay->start_tick + 1;
+}
+
+bool replay_next_keys(Replay_Player *player, uint16_t *keys)
+{
+    const Replay *replay = player->replay;
+    while (player->run < replay->runs.size() &&
+           player->run_tick >= replay->runs[player->run].count)
+    {
+        ++player->run;
+        player->run_tick = 0;
+    }
+    if (player->run >= replay->runs.size())
+    {
+        return false;
+    }
+
+    *keys = replay->runs[player->run].keys;
+    ++player->run_tick;
+    ++player->tick;
+    return true;
+}
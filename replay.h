@@ -0,0 +1,70 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <cstdint>
+#include <vector>
+
+#include "tetris.h"
+
+// Replay file, all values little endian:
+//
+//   char[4]   "TRPL"
+//   uint32    version
+//   uint32    seed
+//   int32     start level
+//   uint32    start tick
+//   uint16    keys held on the start tick
+//   int32     key frame count on the start tick
+//   int32     key skip count on the start tick
+//   uint32    tick count
+//   uint32    run count
+//   runs      uint16 keys, uint16 tick count
+//
+// The game starts on the start tick exactly as start_game leaves it, every
+// following tick feeds one raw key mask to update_input.
+#define REPLAY_MAGIC "TRPL"
+#define REPLAY_VERSION 2
+
+struct Replay_Run
+{
+    uint16_t keys;
+    uint16_t count;
+};
+
+struct Replay
+{
+    uint32_t seed;
+    int32_t start_level;
+    uint32_t start_tick;
+    uint16_t start_keys;
+    int32_t start_key_frame_count;
+    int32_t start_key_skip_count;
+    uint32_t tick_count;
+    std::vector<Replay_Run> runs;
+};
+
+struct Replay_Player
+{
+    const Replay *replay;
+    uint32_t run;
+    uint32_t run_tick;
+    uint32_t tick;
+};
+
+// Recording, call replay_begin right after the tick that started the game
+// and replay_record with the keys of every tick after that.
+void replay_begin(Replay *replay, const Game_State *game,
+                  const Input_State *input, uint32_t seed, uint32_t tick);
+void replay_record(Replay *replay, uint16_t keys);
+
+bool replay_save(const Replay *replay, const char *filename);
+bool replay_load(Replay *replay, const char *filename);
+
+// Playback, puts game and input in the recorded start state. Returns the
+// first tick to run after the start.
+uint64_t replay_start(Replay_Player *player, const Replay *replay,
+                      Game_State *game, Input_State *input);
+// Keys for the next tick, false once the replay is over.
+bool replay_next_keys(Replay_Player *player, uint16_t *keys);
+
+#endif
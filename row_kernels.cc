@@ -0,0 +1,128 @@
+#include <cstdint>
+#include <cstring>
+
+#include "simd.h"
+#include "row_kernels.h"
+
+uint64_t match_rows_scalar(const uint8_t *values, int32_t count,
+                           uint8_t value)
+{
+    uint64_t mask = 0;
+    for (int32_t row = 0; row < count; ++row)
+    {
+        if (values[row] == value)
+        {
+            mask |= 1ull << row;
+        }
+    }
+    return mask;
+}
+
+void compact_rows_scalar(void *rows, int32_t row_size, int32_t height,
+                         uint64_t clear_mask)
+{
+    uint8_t *bytes = (uint8_t *)rows;
+    int32_t src_row = height - 1;
+    for (int32_t dst_row = height - 1; dst_row >= 0; --dst_row)
+    {
+        while (src_row >= 0 && ((clear_mask >> src_row) & 1))
+        {
+            --src_row;
+        }
+
+        if (src_row < 0)
+        {
+            memset(bytes + dst_row * row_size, 0, row_size);
+        }
+        else
+        {
+            if (src_row != dst_row)
+            {
+                memcpy(bytes + dst_row * row_size,
+                       bytes + src_row * row_size,
+                       row_size);
+            }
+            --src_row;
+        }
+    }
+}
+
+#ifdef TETRIS_SSE2
+
+uint64_t match_rows(const uint8_t *values, int32_t count, uint8_t value)
+{
+    if (count < 16)
+    {
+        return match_rows_scalar(values, count, value);
+    }
+
+    uint64_t mask = 0;
+    int32_t row = 0;
+#ifdef TETRIS_AVX2
+    __m256i wide_value = _mm256_set1_epi8((char)value);
+    for (; row + 32 <= count; row += 32)
+    {
+        __m256i wide = _mm256_loadu_si256((const __m256i *)(values + row));
+        uint32_t bits = (uint32_t)_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(wide, wide_value));
+        mask |= (uint64_t)bits << row;
+    }
+#endif
+    // The last load is moved back to end at count, overlapping rows
+    // already tested instead of reading past the end.
+    __m128i narrow_value = _mm_set1_epi8((char)value);
+    for (; row < count; row += 16)
+    {
+        int32_t start = row + 16 <= count ? row : count - 16;
+        __m128i narrow = _mm_loadu_si128((const __m128i *)(values + start));
+        uint32_t bits = (uint32_t)_mm_movemask_epi8(
+            _mm_cmpeq_epi8(narrow, narrow_value));
+        mask |= (uint64_t)bits << start;
+    }
+    return mask;
+}
+
+#else
+
+uint64_t match_rows(const uint8_t *values, int32_t count, uint8_t value)
+{
+    return match_rows_scalar(values, count, value);
+}
+
+#endif
+
+// Walks up from the bottom moving each run of kept rows between cleared
+// ones with a single memmove, so the copies are as wide as the run.
+void compact_rows(void *rows, int32_t row_size, int32_t height,
+                  uint64_t clear_mask)
+{
+    uint8_t *bytes = (uint8_t *)rows;
+    // Rows from dst_end down are final, rows from src_end down are read.
+    int32_t dst_end = height;
+    int32_t src_end = height;
+    for (int32_t row = height - 1; row >= 0 && clear_mask; --row)
+    {
+        if (!((clear_mask >> row) & 1))
+        {
+            continue;
+        }
+        clear_mask &= ~(1ull << row);
+
+        int32_t run = src_end - (row + 1);
+        if (run > 0 && dst_end != src_end)
+        {
+            memmove(bytes + (dst_end - run) * row_size,
+                    bytes + (row + 1) * row_size,
+                    (size_t)run * row_size);
+        }
+        dst_end -= run;
+        src_end = row;
+    }
+
+    int32_t shift = dst_end - src_end;
+    if (shift > 0)
+    {
+        memmove(bytes + shift * row_size, bytes, (size_t)src_end * row_size);
+        memset(bytes, 0, (size_t)shift * row_size);
+    }
+}
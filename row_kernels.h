@@ -0,0 +1,24 @@
+#ifndef ROW_KERNELS_H
+#define ROW_KERNELS_H
+
+#include <cstdint>
+
+// Whole-board row operations for boards up to 64 rows. The row test uses SSE2
+// or AVX2 when the compiler targets them and TETRIS_NO_SIMD is not defined.
+// Compaction moves each run of kept rows with one memmove.
+
+// Bit N is set when values[N] == value, count is at most 64.
+uint64_t match_rows(const uint8_t *values, int32_t count, uint8_t value);
+
+// Removes the rows in clear_mask from height rows of row_size bytes, moving
+// the rows above them down and zeroing the rows freed at the top.
+void compact_rows(void *rows, int32_t row_size, int32_t height,
+                  uint64_t clear_mask);
+
+// Plain loop versions, always available for testing and benchmarks.
+uint64_t match_rows_scalar(const uint8_t *values, int32_t count,
+                           uint8_t value);
+void compact_rows_scalar(void *rows, int32_t row_size, int32_t height,
+                         uint64_t clear_mask);
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// Instruction sets for the hand vectorized kernels, read from what the
+// compiler targets so ARCH in the Makefile is the only switch. SSE2 is part
+// of x86-64 and is used whenever it is available, AVX2 only when the code is
+// built for it (-mavx2 or /arch:AVX2). TETRIS_NO_SIMD forces the plain loop
+// versions everywhere.
+#if !defined(TETRIS_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+#define TETRIS_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(TETRIS_SSE2) && defined(__AVX2__)
+#define TETRIS_AVX2
+#include <immintrin.h>
+#endif
+
+#endif
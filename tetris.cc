@@ -12,57 +12,56 @@
 
 #include "colors.h"
 #include "tetris.h"
+#include "replay.h"
+#include "ai.h"
+#include "frame_stats.h"
 
 #ifdef AUDIO
 #include "audio.h"
-Audio * drop_sound;
-Audio * clear_sound;
-Audio * hiscore_sound;
-Audio * pause_sound;
-Audio * gameover_sound;
+enum Sound
+{
+    SOUND_DROP,
+    SOUND_CLEAR,
+    SOUND_HISCORE,
+    SOUND_PAUSE,
+    SOUND_GAMEOVER,
+    SOUND_COUNT
+};
+const char *SOUND_FILENAMES[SOUND_COUNT] = {
+    "sounds/drop.wav",
+    "sounds/clear.wav",
+    "sounds/hiscore.wav",
+    "sounds/pause.wav",
+    "sounds/gameover.wav"
+};
+SoundHandle sounds[SOUND_COUNT];
 bool play_hiscore = true;
 #endif
 
-
-void fps_init() 
+// Catch-up limit for the fixed 60 Hz simulation when frames are dropped.
+#define MAX_UPDATES_PER_FRAME 5
+
+// The front end plays the default board, the window and everything drawn are
+// sized from its geometry, with the score area above the board.
+typedef Game_State::Geometry Screen_Geometry;
+#define BOARD_MARGIN_Y 60
+#define SCREEN_WIDTH (Screen_Geometry::width * GRID_SIZE)
+#define SCREEN_HEIGHT (BOARD_MARGIN_Y + Screen_Geometry::height * GRID_SIZE)
+
+// Frame timing. The summary text is rebuilt every FRAME_REPORT_INTERVAL
+// frames rather than every frame so the text cache keeps its labels.
+#define FRAME_REPORT_INTERVAL 30
+Frame_Stats frame_stats;
+bool show_frame_stats = false;
+float framespersecond;
+char frame_report[FRAME_PHASE_COUNT][5][16];
+
+enum Text_Align
 {
-    memset(frametimes, 0, sizeof(frametimes));
-    framecount = 0;
-    framespersecond = 0;
-    frametimelast = SDL_GetTicks();
-}
-
-void fps_process() 
-{
-    uint32_t frametimesindex;
-    uint32_t getticks;
-    uint32_t count;
-    uint32_t i;
-
-    frametimesindex = framecount % FRAME_VALUES;
-    getticks = SDL_GetTicks();
-    frametimes[frametimesindex] = getticks - frametimelast;
-    frametimelast = getticks;
-    framecount++;
-
-    if (framecount < FRAME_VALUES)
-    {
-        count = framecount;
-    }
-    else
-    {
-        count = FRAME_VALUES;
-    }
-
-    framespersecond = 0;
-    for (i = 0; i < count; i++)
-    {
-        framespersecond += frametimes[i];
-    }
-
-    framespersecond /= count;
-    framespersecond = 1000.f / framespersecond;
-}
+    TEXT_ALIGN_LEFT,
+    TEXT_ALIGN_CENTER,
+    TEXT_ALIGN_RIGHT
+};
 
 int32_t read_hiscore()
 {
@@ -85,578 +84,535 @@ void write_hiscore(int32_t hiscore)
     outfile << hiscore_str;
 }
 
-uint8_t matrix_get(const uint8_t *values, int32_t width, int32_t row,
-                   int32_t col)
+void fill_rect(SDL_Renderer *renderer, int32_t x, int32_t y, int32_t width,
+               int32_t height, Color color)
 {
-    int32_t index = row * width + col;
-    return values[index];
+    SDL_Rect rect = {};
+    rect.x = x;
+    rect.y = y;
+    rect.w = width;
+    rect.h = height;
+    SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a);
+    SDL_RenderFillRect(renderer, &rect);
 }
 
-void matrix_set(uint8_t *values, int32_t width, int32_t row, int32_t col,
-                uint8_t value)
-{
-    int32_t index = row * width + col;
-    values[index] = value;
-}
 
-uint8_t tetromino_get(const Tetromino *tetromino, int32_t row, int32_t col,
-                    int32_t rotation)
+void draw_rect(SDL_Renderer *renderer, int32_t x, int32_t y, int32_t width,
+               int32_t height, Color color)
 {
-    int32_t side = tetromino->side;
-    switch (rotation)
-    {
-    case 0:
-        return tetromino->data[row * side + col];
-    case 1:
-        return tetromino->data[(side - col - 1) * side + row];
-    case 2:
-        return tetromino->data[(side - row - 1) * side + (side - col - 1)];
-    case 3:
-        return tetromino->data[col * side + (side - row - 1)];
-    }
-    return 0;
+    SDL_Rect rect = {};
+    rect.x = x;
+    rect.y = y;
+    rect.w = width;
+    rect.h = height;
+    SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a);
+    SDL_RenderDrawRect(renderer, &rect);
 }
 
-uint8_t check_row_filled(const uint8_t *values, int32_t width, int32_t row)
-{
-    for (int32_t col = 0; col < width; ++col)
-    {
-        if (!matrix_get(values, width, row, col))
-        {
-            return 0;
-        }
-    }
-    return 1;
-}
+// Printable ASCII, rasterized once per font at startup.
+#define GLYPH_FIRST 32
+#define GLYPH_LAST 126
+#define GLYPH_COUNT (GLYPH_LAST - GLYPH_FIRST + 1)
 
-uint8_t check_row_empty(const uint8_t *values, int32_t width, int32_t row)
+struct Glyph_Atlas
 {
-    for (int32_t col = 0; col < width; ++col)
-    {
-        if (matrix_get(values, width, row, col))
-        {
-            return 0;
-        }
-    }
-    return 1;
-}
-
-int32_t find_lines(const uint8_t *values, int32_t width, int32_t height,
-                   uint8_t *lines_out)
+    SDL_Texture *texture;
+    SDL_Rect glyphs[GLYPH_COUNT];
+    int32_t advances[GLYPH_COUNT];
+    int32_t height;
+};
+
+bool create_glyph_atlas(Glyph_Atlas *atlas, SDL_Renderer *renderer,
+                        TTF_Font *font)
 {
-    int32_t count = 0;
-    for (int32_t row = 0; row < height; ++row)
-    {
-        uint8_t filled = check_row_filled(values, width, row);
-        lines_out[row] = filled;
-        count += filled;
-    }
-    return count;
-}
+    SDL_Color white = SDL_Color { 0xFF, 0xFF, 0xFF, 0xFF };
+    SDL_Surface *surfaces[GLYPH_COUNT] = {};
+    char text[2] = {};
+    int32_t atlas_width = 0;
 
-void clear_lines(uint8_t *values, int32_t width, int32_t height, 
-                 const uint8_t *lines)
-{
-    int32_t src_row = height - 1;
-    for (int32_t dst_row = height - 1; dst_row >= 0; --dst_row)
-    {
-        while (src_row >= 0 && lines[src_row])
-        {
-            --src_row;
-        }
+    *atlas = {};
+    atlas->height = TTF_FontHeight(font);
 
-        if (src_row < 0)
-        {
-            memset(values + dst_row * width, 0, width);
-        }
-        else 
+    for (int32_t i = 0; i < GLYPH_COUNT; ++i)
+    {
+        int32_t advance = 0;
+        text[0] = (char)(GLYPH_FIRST + i);
+        TTF_GlyphMetrics(font, text[0], 0, 0, 0, 0, &advance);
+        atlas->advances[i] = advance;
+
+        // Rendered as text so each glyph matches TTF_RenderText_Solid.
+        surfaces[i] = TTF_RenderText_Solid(font, text, white);
+        if (surfaces[i])
         {
-            if (src_row != dst_row)
-            {
-                memcpy(values + dst_row * width,
-                       values + src_row * width,
-                       width);
-            }
-            --src_row;
+            atlas->glyphs[i] = { atlas_width, 0, surfaces[i]->w,
+                                 surfaces[i]->h };
+            atlas_width += surfaces[i]->w;
         }
     }
-}
-
-bool check_piece_valid(const Piece_State *piece, const uint8_t *board,
-                       int32_t width, int32_t height)
-{
-    const Tetromino *tetromino = TETROMINOS + piece->tetromino_index;
 
-    for (int32_t row = 0; row < tetromino->side; ++row)
+    SDL_Surface *atlas_surface = SDL_CreateRGBSurfaceWithFormat(
+        0, atlas_width > 0 ? atlas_width : 1, atlas->height, 32,
+        SDL_PIXELFORMAT_ARGB8888);
+    if (atlas_surface)
     {
-        for (int32_t col = 0; col < tetromino->side; ++col)
+        SDL_FillRect(atlas_surface, 0, 0);
+        for (int32_t i = 0; i < GLYPH_COUNT; ++i)
         {
-            uint8_t value = tetromino_get(tetromino, row, col,
-                                          piece->rotation);
-            if (value > 0)
+            if (surfaces[i])
             {
-                int32_t board_row = piece->offset_row + row;
-                int32_t board_col = piece->offset_col + col;
-                if (board_row < 0)
-                {
-                    return false;
-                }
-                if (board_row >= height)
-                {
-                    return false;
-                }
-                if (board_col < 0)
-                {
-                    return false;
-                }
-                if (board_col >= width)
-                {
-                    return false;
-                }
-                if (matrix_get(board, width, board_row, board_col))
-                {
-                    return false;
-                }
+                SDL_Rect rect = atlas->glyphs[i];
+                SDL_BlitSurface(surfaces[i], 0, atlas_surface, &rect);
             }
         }
+        atlas->texture = SDL_CreateTextureFromSurface(renderer,
+                                                      atlas_surface);
+        SDL_FreeSurface(atlas_surface);
     }
-    return true;
-}
 
-void merge_piece(Game_State *game)
-{
-    const Tetromino *tetromino = TETROMINOS + game->piece.tetromino_index;
-    for (int32_t row = 0; row < tetromino->side; ++row)
+    for (int32_t i = 0; i < GLYPH_COUNT; ++i)
     {
-        for (int32_t col = 0; col < tetromino->side; ++col)
-        {
-            uint8_t value = tetromino_get(tetromino, row, col,
-                                          game->piece.rotation);
-            if (value)
-            {
-                int32_t board_row = game->piece.offset_row + row;
-                int32_t board_col = game->piece.offset_col + col;
-                matrix_set(game->board, WIDTH, board_row, board_col, value);
-            }
-        }
+        SDL_FreeSurface(surfaces[i]);
     }
-}
 
-int32_t random_int(int32_t min, int32_t max)
-{
-    int32_t range = max - min;
-    return min + rand() % range;
-}
-
-float get_time_to_next_drop(int32_t level)
-{
-    if (level > 29)
+    if (!atlas->texture)
     {
-        level = 29;
+        return false;
     }
-    return FRAMES_PER_DROP[level] * TARGET_SECONDS_PER_FRAME;
+    SDL_SetTextureBlendMode(atlas->texture, SDL_BLENDMODE_BLEND);
+    return true;
 }
 
-void random_next_piece(Game_State *game)
+void destroy_glyph_atlas(Glyph_Atlas *atlas)
 {
-    game->tetromino_next = (uint8_t)random_int(0, ARRAY_COUNT(TETROMINOS));
+    SDL_DestroyTexture(atlas->texture);
+    *atlas = {};
 }
 
-void spawn_piece(Game_State *game)
+int32_t glyph_index(char c)
 {
-    game->piece = {};
-    game->piece.tetromino_index = game->tetromino_next;
-    game->piece.offset_col = WIDTH / 2;
-    game->next_drop_time = game->time + get_time_to_next_drop(game->level);
+    if (c < GLYPH_FIRST || c > GLYPH_LAST)
+    {
+        return '?' - GLYPH_FIRST;
+    }
+    return c - GLYPH_FIRST;
 }
 
-
-bool soft_drop(Game_State *game)
+int32_t measure_string(const Glyph_Atlas *atlas, const char *text)
 {
-    ++game->piece.offset_row;
-    if (!check_piece_valid(&game->piece, game->board, WIDTH, HEIGHT))
+    int32_t width = 0;
+    for (const char *c = text; *c; ++c)
     {
-        --game->piece.offset_row;
-        merge_piece(game);
-        spawn_piece(game);
-        random_next_piece(game);
-
-#ifdef AUDIO
-        playSoundFromMemory(drop_sound, SDL_MIX_MAXVOLUME / 2);
-#endif
-
-        return false;
+        width += atlas->advances[glyph_index(*c)];
     }
-    game->next_drop_time = game->time + get_time_to_next_drop(game->level);
-    return true;
+    return width;
 }
 
-int32_t compute_score(int32_t level, int32_t line_count)
+void draw_glyphs(SDL_Renderer *renderer, const Glyph_Atlas *atlas,
+                 const char *text, int32_t x, int32_t y)
 {
-    switch (line_count)
+    for (const char *c = text; *c; ++c)
     {
-    case 1:
-        return 40 * (level + 1);
-    case 2:
-        return 100 * (level + 1);
-    case 3:
-        return 300 * (level + 1);
-    case 4:
-        return 1200 * (level + 1);
+        int32_t index = glyph_index(*c);
+        const SDL_Rect *glyph = &atlas->glyphs[index];
+        if (glyph->w > 0)
+        {
+            SDL_Rect rect = { x, y, glyph->w, glyph->h };
+            SDL_RenderCopy(renderer, atlas->texture, glyph, &rect);
+        }
+        x += atlas->advances[index];
     }
-    return 0;
 }
 
-int32_t min(int32_t x, int32_t y)
+// Labels composed into their own texture, so a steady label is a single
+// copy per frame and is only redrawn when its text changes. Color is applied
+// when drawing, the key is font and text.
+#define TEXT_CACHE_SIZE 32
+#define TEXT_CACHE_MAX_LENGTH 64
+
+struct Text_Cache_Entry
 {
-    return x < y ? x : y;
-}
-int32_t max(int32_t x, int32_t y)
+    const Glyph_Atlas *atlas;
+    uint32_t hash;
+    char text[TEXT_CACHE_MAX_LENGTH];
+    SDL_Texture *texture;
+    int32_t texture_width;
+    int32_t width;
+    uint32_t last_used;
+};
+
+struct Text_Cache
 {
-    return x > y ? x : y;
-}
+    bool enabled;
+    uint32_t use_count;
+    Text_Cache_Entry entries[TEXT_CACHE_SIZE];
+};
 
-int32_t get_lines_for_next_level(int32_t start_level, int32_t level)
-{
-    int32_t first_level_up_limit = min(
-        (start_level * 10 + 10),
-        max(100, (start_level * 10 - 50)));
-    if (level == start_level)
-    {
-        return first_level_up_limit;
-    }
-    int32_t diff = level - start_level;
-    return first_level_up_limit + diff * 10;
-}
+Text_Cache text_cache;
 
-void update_game_start(Game_State *game, const Input_State *input)
+void text_cache_init(SDL_Renderer *renderer)
 {
-    if (input->dup > 0)
-    {
-        ++game->start_level;
-    }
-
-    if (input->ddown > 0 && game->start_level > 0)
-    {
-        --game->start_level;
-    }
-    
-    if (input->dspace > 0)
-    {
-        memset(game->board, 0, WIDTH * HEIGHT);
-        game->level = game->start_level;
-        game->line_count = 0;
-        game->score = 0;
-        spawn_piece(game);
-        random_next_piece(game);
-        game->phase = GAME_PHASE_PLAY;
-    }
+    text_cache = {};
+    text_cache.enabled = SDL_RenderTargetSupported(renderer);
 }
 
-void update_game_pause(Game_State *game, const Input_State *input)
+// Contents of target textures are lost on SDL_RENDER_TARGETS_RESET, the
+// textures themselves are kept for reuse.
+void text_cache_invalidate()
 {
-    if (input->dp > 0)
+    for (int32_t i = 0; i < TEXT_CACHE_SIZE; ++i)
     {
-        game->phase = GAME_PHASE_PLAY;
-#ifdef AUDIO
-        playSoundFromMemory(pause_sound, SDL_MIX_MAXVOLUME / 2);
-#endif
+        text_cache.entries[i].atlas = 0;
     }
 }
 
-void update_game_gameover(Game_State *game, const Input_State *input)
+void text_cache_free()
 {
-    if (input->dspace > 0)
+    for (int32_t i = 0; i < TEXT_CACHE_SIZE; ++i)
     {
-        game->phase = GAME_PHASE_START;
-        memset(game->board, 0, WIDTH * HEIGHT);
+        SDL_DestroyTexture(text_cache.entries[i].texture);
     }
+    text_cache = {};
 }
 
-void update_game_line(Game_State *game)
+uint32_t hash_string(const char *text)
 {
-    if (game->time >= game->highlight_end_time)
+    uint32_t hash = 2166136261u;
+    for (const char *c = text; *c; ++c)
     {
-        clear_lines(game->board, WIDTH, HEIGHT, game->lines);
-        game->line_count += game->pending_line_count;
-        game->score += compute_score(game->level, game->pending_line_count);
-
-        int32_t lines_for_next_level = get_lines_for_next_level(
-                                                            game->start_level,
-                                                            game->level);
-        if (game->line_count >= lines_for_next_level)
-        {
-            ++game->level;
-        }
-        
-        game->phase = GAME_PHASE_PLAY;
+        hash = (hash ^ (uint8_t)*c) * 16777619u;
     }
+    return hash;
 }
 
-void update_game_play(Game_State *game, const Input_State *input)
+Text_Cache_Entry *text_cache_get(SDL_Renderer *renderer,
+                                 const Glyph_Atlas *atlas, const char *text)
 {
-    Piece_State piece = game->piece;
-    if (input->da > 0)
+    if (!text_cache.enabled || strlen(text) >= TEXT_CACHE_MAX_LENGTH)
     {
-        --piece.offset_col;
-    }
-    if (input->dd > 0)
-    {
-        ++piece.offset_col;
-    }
-    if (input->dright > 0)
-    {
-        piece.rotation = (piece.rotation + 1) % 4;
+        return 0;
     }
 
-    if (input->dleft > 0)
+    uint32_t hash = hash_string(text);
+    Text_Cache_Entry *oldest = &text_cache.entries[0];
+    for (int32_t i = 0; i < TEXT_CACHE_SIZE; ++i)
     {
-        piece.rotation = (piece.rotation + 3) % 4;
+        Text_Cache_Entry *entry = &text_cache.entries[i];
+        if (entry->atlas == atlas && entry->hash == hash &&
+            strcmp(entry->text, text) == 0)
+        {
+            entry->last_used = ++text_cache.use_count;
+            return entry;
+        }
+        if (entry->last_used < oldest->last_used)
+        {
+            oldest = entry;
+        }
     }
 
-    if (check_piece_valid(&piece, game->board, WIDTH, HEIGHT))
+    // Miss, redraw the least recently used entry.
+    Text_Cache_Entry *entry = oldest;
+    int32_t width = measure_string(atlas, text);
+    if (width <= 0)
     {
-        game->piece = piece;
+        return 0;
     }
-
-    if (input->ds > 0 || input->ddown > 0)
+    if (!entry->texture || entry->texture_width < width ||
+        entry->atlas != atlas)
     {
-        soft_drop(game);
+        int32_t texture_width = (width + 63) & ~63;
+        SDL_DestroyTexture(entry->texture);
+        *entry = {};
+        entry->texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+                                           SDL_TEXTUREACCESS_TARGET,
+                                           texture_width, atlas->height);
+        if (!entry->texture)
+        {
+            return 0;
+        }
+        entry->texture_width = texture_width;
+        SDL_SetTextureBlendMode(entry->texture, SDL_BLENDMODE_BLEND);
     }
 
-    if (input->dspace > 0)
-    {
-        while(soft_drop(game));
-    }
-    
-    while (game->time >= game->next_drop_time)
-    {
-        soft_drop(game);
-    }
+    SDL_SetRenderTarget(renderer, entry->texture);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+    SDL_RenderClear(renderer);
+    SDL_SetTextureColorMod(atlas->texture, 0xFF, 0xFF, 0xFF);
+    SDL_SetTextureAlphaMod(atlas->texture, 0xFF);
+    draw_glyphs(renderer, atlas, text, 0, 0);
+    SDL_SetRenderTarget(renderer, 0);
+
+    entry->atlas = atlas;
+    entry->hash = hash;
+    strcpy(entry->text, text);
+    entry->width = width;
+    entry->last_used = ++text_cache.use_count;
+    return entry;
+}
 
-    game->pending_line_count = find_lines(game->board, WIDTH, HEIGHT,
-                                          game->lines);
-    if (game->pending_line_count > 0)
-    {
-#ifdef AUDIO
-        playSoundFromMemory(clear_sound, SDL_MIX_MAXVOLUME / 2);
-#endif
-        game->phase = GAME_PHASE_LINE;
-        game->highlight_end_time = game->time + 0.5f;
-    }
+void draw_string(SDL_Renderer *renderer, const Glyph_Atlas *atlas,
+                 const char *text, int32_t x, int32_t y, Text_Align alignment,
+                 Color color)
+{
+    Text_Cache_Entry *entry = text_cache_get(renderer, atlas, text);
+    int32_t width = entry ? entry->width : measure_string(atlas, text);
 
-    int32_t game_over_row = 2;
-    if (!check_row_empty(game->board, WIDTH, game_over_row))
+    switch (alignment)
     {
-        game->phase = GAME_PHASE_GAMEOVER;
-#ifdef AUDIO
-        playSoundFromMemory(gameover_sound, SDL_MIX_MAXVOLUME / 2);
-#endif
+    case TEXT_ALIGN_LEFT:
+        break;
+    case TEXT_ALIGN_CENTER:
+        x -= width / 2;
+        break;
+    case TEXT_ALIGN_RIGHT:
+        x -= width;
+        break;
     }
 
-    if (input->dp > 0)
+    // Same alpha rule as TTF_RenderText_Solid.
+    uint8_t alpha = color.a ? color.a : 0xFF;
+
+    if (entry)
     {
-        game->phase = GAME_PHASE_PAUSE;
-#ifdef AUDIO
-        playSoundFromMemory(pause_sound, SDL_MIX_MAXVOLUME / 2);
-#endif
+        SDL_Rect src = { 0, 0, entry->width, atlas->height };
+        SDL_Rect dst = { x, y, entry->width, atlas->height };
+        SDL_SetTextureColorMod(entry->texture, color.r, color.g, color.b);
+        SDL_SetTextureAlphaMod(entry->texture, alpha);
+        SDL_RenderCopy(renderer, entry->texture, &src, &dst);
+        return;
     }
 
+    SDL_SetTextureColorMod(atlas->texture, color.r, color.g, color.b);
+    SDL_SetTextureAlphaMod(atlas->texture, alpha);
+    draw_glyphs(renderer, atlas, text, x, y);
 }
 
-void update_game(Game_State *game, const Input_State *input)
+// One bevelled tile per palette entry, full size in the top row and preview
+// size below, so each cell is a single copy.
+#define CELL_ATLAS_COUNT ARRAY_COUNT(BASE_COLORS)
+#define PREVIEW_GRID_SIZE (GRID_SIZE / 2)
+
+struct Cell_Atlas
 {
-    switch(game->phase)
-    {
-    case GAME_PHASE_START:
-        update_game_start(game, input);
-        break;
-    case GAME_PHASE_PLAY:
-        update_game_play(game, input);
-        break;
-    case GAME_PHASE_LINE:
-        update_game_line(game);
-        break;
-    case GAME_PHASE_PAUSE:
-        update_game_pause(game, input);
-        break;
-    case GAME_PHASE_GAMEOVER:
-        update_game_gameover(game, input);
-        break;
-    }
-}
+    SDL_Texture *texture;
+};
 
-void fill_rect(SDL_Renderer *renderer, int32_t x, int32_t y, int32_t width,
-               int32_t height, Color color)
+Cell_Atlas cell_atlas;
+
+void fill_surface_rect(SDL_Surface *surface, int32_t x, int32_t y,
+                       int32_t width, int32_t height, Color color)
 {
-    SDL_Rect rect = {};
-    rect.x = x;
-    rect.y = y;
-    rect.w = width;
-    rect.h = height;
-    SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a);
-    SDL_RenderFillRect(renderer, &rect);
+    SDL_Rect rect = { x, y, width, height };
+    SDL_FillRect(surface, &rect,
+                 SDL_MapRGBA(surface->format, color.r, color.g, color.b,
+                             color.a));
 }
 
-
-void draw_rect(SDL_Renderer *renderer, int32_t x, int32_t y, int32_t width,
-               int32_t height, Color color)
+void draw_cell_tile(SDL_Surface *surface, int32_t x, int32_t y, int32_t size,
+                    uint8_t value)
 {
-    SDL_Rect rect = {};
-    rect.x = x;
-    rect.y = y;
-    rect.w = width;
-    rect.h = height;
-    SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a);
-    SDL_RenderDrawRect(renderer, &rect);
+    int32_t edge = size / 8;
+
+    fill_surface_rect(surface, x, y, size, size, DARK_COLORS[value]);
+    fill_surface_rect(surface, x + edge, y, size - edge, size - edge,
+                      LIGHT_COLORS[value]);
+    fill_surface_rect(surface, x + edge, y + edge,
+                      size - edge * 2, size - edge * 2, BASE_COLORS[value]);
 }
 
-void draw_string(SDL_Renderer *renderer, TTF_Font *font, const char *text,
-                 int32_t x, int32_t y, Text_Align alignment, Color color)
+bool create_cell_atlas(Cell_Atlas *atlas, SDL_Renderer *renderer)
 {
-    SDL_Color sdl_color = SDL_Color { color.r, color.g, color.b, color.a };
-    SDL_Surface *surface = TTF_RenderText_Solid(font, text, sdl_color);
-    SDL_Texture *texture = SDL_CreateTextureFromSurface(renderer, surface);
+    SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormat(
+        0, CELL_ATLAS_COUNT * GRID_SIZE, GRID_SIZE + PREVIEW_GRID_SIZE, 32,
+        SDL_PIXELFORMAT_ARGB8888);
+    if (!surface)
+    {
+        return false;
+    }
 
-    SDL_Rect rect;
-    rect.y = y;
-    rect.w = surface->w;
-    rect.h = surface->h;
-    switch (alignment)
+    for (uint8_t value = 0; value < CELL_ATLAS_COUNT; ++value)
     {
-    case TEXT_ALIGN_LEFT:
-        rect.x = x;
-        break;
-    case TEXT_ALIGN_CENTER:
-        rect.x = x - surface->w / 2;
-        break;
-    case TEXT_ALIGN_RIGHT:
-        rect.x = x - surface->w;
-        break;
+        draw_cell_tile(surface, value * GRID_SIZE, 0, GRID_SIZE, value);
+        draw_cell_tile(surface, value * GRID_SIZE, GRID_SIZE,
+                       PREVIEW_GRID_SIZE, value);
     }
 
-    SDL_RenderCopy(renderer, texture, 0, &rect);
+    atlas->texture = SDL_CreateTextureFromSurface(renderer, surface);
     SDL_FreeSurface(surface);
-    SDL_DestroyTexture(texture);
+    return atlas->texture != 0;
+}
+
+void destroy_cell_atlas(Cell_Atlas *atlas)
+{
+    SDL_DestroyTexture(atlas->texture);
+    *atlas = {};
 }
 
 void draw_cell(SDL_Renderer *renderer, int32_t row, int32_t col, uint8_t value,
                int32_t offset_x, int32_t offset_y, bool outline = false)
 {
-    Color base_color = BASE_COLORS[value];
-    Color light_color = LIGHT_COLORS[value];
-    Color dark_color = DARK_COLORS[value];
-   
-    int32_t edge = GRID_SIZE / 8;
-
     int32_t x = col * GRID_SIZE + offset_x;
     int32_t y = row * GRID_SIZE + offset_y;
 
     if (outline)
     {
-        draw_rect(renderer, x, y, GRID_SIZE, GRID_SIZE, base_color);
+        draw_rect(renderer, x, y, GRID_SIZE, GRID_SIZE, BASE_COLORS[value]);
         return;
     }
-    
-    fill_rect(renderer, x, y, GRID_SIZE, GRID_SIZE, dark_color);
-    fill_rect(renderer, x + edge, y, GRID_SIZE - edge, GRID_SIZE - edge,
-              light_color);
-    fill_rect(renderer, x + edge, y + edge,
-              GRID_SIZE - edge * 2, GRID_SIZE - edge * 2, base_color); 
+
+    SDL_Rect src = { value * GRID_SIZE, 0, GRID_SIZE, GRID_SIZE };
+    SDL_Rect dst = { x, y, GRID_SIZE, GRID_SIZE };
+    SDL_RenderCopy(renderer, cell_atlas.texture, &src, &dst);
 }
 
 void draw_preview_cell(SDL_Renderer *renderer, int32_t row, int32_t col,
                        uint8_t value, int32_t offset_x, int32_t offset_y,
                        bool outline = false)
 {
-    Color base_color = BASE_COLORS[value];
-    Color light_color = LIGHT_COLORS[value];
-    Color dark_color = DARK_COLORS[value];
-   
-    int32_t edge = GRID_SIZE / 16;
-
-    int32_t x = col * (GRID_SIZE / 2) + offset_x;
-    int32_t y = row * (GRID_SIZE / 2) + offset_y;
+    int32_t x = col * PREVIEW_GRID_SIZE + offset_x;
+    int32_t y = row * PREVIEW_GRID_SIZE + offset_y;
 
     if (outline)
     {
-        draw_rect(renderer, x, y, GRID_SIZE / 2, GRID_SIZE / 2, base_color);
+        draw_rect(renderer, x, y, PREVIEW_GRID_SIZE, PREVIEW_GRID_SIZE,
+                  BASE_COLORS[value]);
         return;
     }
-    
-    fill_rect(renderer, x, y, GRID_SIZE / 2, GRID_SIZE / 2, dark_color);
-    fill_rect(renderer, x + edge, y, (GRID_SIZE / 2) - edge,
-              (GRID_SIZE / 2) - edge, light_color);
-    fill_rect(renderer, x + edge, y + edge,
-              (GRID_SIZE / 2) - edge * 2, (GRID_SIZE / 2) - edge * 2,
-              base_color); 
+
+    SDL_Rect src = { value * GRID_SIZE, GRID_SIZE,
+                     PREVIEW_GRID_SIZE, PREVIEW_GRID_SIZE };
+    SDL_Rect dst = { x, y, PREVIEW_GRID_SIZE, PREVIEW_GRID_SIZE };
+    SDL_RenderCopy(renderer, cell_atlas.texture, &src, &dst);
 }
 
 void draw_piece(SDL_Renderer *renderer, const Piece_State *piece,
                 int32_t offset_x, int32_t offset_y, bool outline = false)
 {
-    const Tetromino *tetromino = TETROMINOS + piece->tetromino_index;
-    for (int32_t row = 0; row < tetromino->side; ++row)
+    const Piece_Shape *shape = piece_shape(piece->tetromino_index,
+                                           piece->rotation);
+    for (int32_t i = 0; i < shape->cell_count; ++i)
     {
-        for (int32_t col = 0; col < tetromino->side; ++col)
-        {
-            uint8_t value = tetromino_get(tetromino, row, col, piece->rotation);
-            if (value)
-            {
-                draw_cell(renderer,
-                          row + piece->offset_row,
-                          col + piece->offset_col,
-                          value,
+        draw_cell(renderer,
+                  shape->cells[i].row + piece->offset_row,
+                  shape->cells[i].col + piece->offset_col,
+                  shape->value,
+                  offset_x, offset_y,
+                  outline);
+    }
+}
+
+void draw_preview(SDL_Renderer *renderer, const Game_State *game,
+                int32_t offset_x, int32_t offset_y, bool outline = false)
+{
+    const Piece_Shape *shape = piece_shape(game->tetromino_next, 0);
+    for (int32_t i = 0; i < shape->cell_count; ++i)
+    {
+        draw_preview_cell(renderer,
+                          shape->cells[i].row,
+                          shape->cells[i].col,
+                          shape->value,
                           offset_x, offset_y,
                           outline);
-            }
+    }
+}
+
+void draw_board_row(SDL_Renderer *renderer, const uint8_t *board,
+                    int32_t width, int32_t row, int32_t offset_x,
+                    int32_t offset_y)
+{
+    fill_rect(renderer, offset_x, offset_y + row * GRID_SIZE,
+              width * GRID_SIZE, GRID_SIZE, BASE_COLORS[0]);
+    for (int32_t col = 0; col < width; ++col)
+    {
+        uint8_t value = matrix_get(board, width, row, col);
+        if (value)
+        {
+            draw_cell(renderer, row, col, value, offset_x, offset_y);
         }
     }
 }
 
-void draw_preview(SDL_Renderer *renderer, const Game_State *game,
-                int32_t offset_x, int32_t offset_y, bool outline = false)
+// The locked board kept in a target texture, only rows the core marked
+// dirty are redrawn into it.
+struct Board_Cache
+{
+    SDL_Texture *texture;
+    bool valid;
+};
+
+Board_Cache board_cache;
+
+void board_cache_init(SDL_Renderer *renderer)
+{
+    board_cache = {};
+    if (SDL_RenderTargetSupported(renderer))
+    {
+        board_cache.texture = SDL_CreateTexture(renderer,
+                                                SDL_PIXELFORMAT_ARGB8888,
+                                                SDL_TEXTUREACCESS_TARGET,
+                                                SCREEN_WIDTH,
+                                                SCREEN_HEIGHT - BOARD_MARGIN_Y);
+    }
+}
+
+void board_cache_free()
 {
-    const Tetromino *tetromino = TETROMINOS + game->tetromino_next;
-    for (int32_t row = 0; row < tetromino->side; ++row)
+    SDL_DestroyTexture(board_cache.texture);
+    board_cache = {};
+}
+
+void board_cache_sync(SDL_Renderer *renderer, Game_State *game)
+{
+    if (!board_cache.texture)
+    {
+        return;
+    }
+
+    uint64_t dirty_rows = game->dirty_rows;
+    if (!board_cache.valid)
+    {
+        dirty_rows = Screen_Geometry::all_rows;
+    }
+    game->dirty_rows = 0;
+
+    if (!dirty_rows)
+    {
+        return;
+    }
+
+    SDL_SetRenderTarget(renderer, board_cache.texture);
+    for (int32_t row = 0; row < Screen_Geometry::height; ++row)
     {
-        for (int32_t col = 0; col < tetromino->side; ++col)
+        if (dirty_rows & (1ull << row))
         {
-            uint8_t value = tetromino_get(tetromino, row, col, 0);
-            if (value)
-            {
-                draw_preview_cell(renderer,
-                                  row,
-                                  col,
-                                  value,
-                                  offset_x, offset_y,
-                                  outline);
-            }
+            draw_board_row(renderer, game->board, Screen_Geometry::width, row,
+                           0, 0);
         }
     }
+    SDL_SetRenderTarget(renderer, 0);
+    board_cache.valid = true;
 }
 
 void draw_board(SDL_Renderer *renderer, const uint8_t *board, int32_t width,
                 int32_t height, int32_t offset_x, int32_t offset_y)
 {
-    fill_rect(renderer, offset_x, offset_y,
-              width * GRID_SIZE, height * GRID_SIZE,
-              BASE_COLORS[0]);
+    if (board_cache.valid)
+    {
+        SDL_Rect rect = { offset_x, offset_y, width * GRID_SIZE,
+                          height * GRID_SIZE };
+        SDL_RenderCopy(renderer, board_cache.texture, 0, &rect);
+        return;
+    }
+
     for (int32_t row = 0; row < height; ++row)
     {
-        for (int32_t col = 0; col < width; ++col)
-        {
-            uint8_t value = matrix_get(board, width, row, col);
-            if (value)
-            {
-                draw_cell(renderer, row, col, value, offset_x, offset_y);
-            }
-        }
+        draw_board_row(renderer, board, width, row, offset_x, offset_y);
     }
 }
 
-void render_game(const Game_State *game, SDL_Renderer *renderer,
-                 TTF_Font *font, TTF_Font *small_font, TTF_Font *tiny_font)
+// The board only changes on ticks, alpha (0..1) is how far the renderer is
+// into the next tick and only drives time based effects.
+void render_game(const Game_State *game, float alpha, SDL_Renderer *renderer,
+                 const Glyph_Atlas *font, const Glyph_Atlas *tiny_font)
 {
     char buffer[256];
     
@@ -664,35 +620,34 @@ void render_game(const Game_State *game, SDL_Renderer *renderer,
     Color gray_color = color(0x77, 0x77, 0x77, 0x77);
     Color flash_color; 
 
-    int32_t margin_y = 60;
+    int32_t margin_y = BOARD_MARGIN_Y;
     
-    draw_board(renderer, game->board, WIDTH, HEIGHT, 0, margin_y);
+    draw_board(renderer, game->board, Screen_Geometry::width,
+               Screen_Geometry::height, 0, margin_y);
 
     if (game->phase == GAME_PHASE_PLAY)
     {
         draw_piece(renderer, &game->piece, 0, margin_y);
 
         Piece_State piece = game->piece;
-        while (check_piece_valid(&piece, game->board, WIDTH, HEIGHT))
-        {
-            piece.offset_row++;
-        }
-        --piece.offset_row;
+        piece.offset_row += get_drop_distance(game, &piece);
         draw_piece(renderer, &piece, 0, margin_y, true);
         
     }
 
     if (game->phase == GAME_PHASE_LINE)
     {
-        for (int32_t row = 0; row < HEIGHT; ++row)
+        for (int32_t row = 0; row < Screen_Geometry::height; ++row)
         {
             if (game->lines[row])
             {
                 int32_t x = 0;
                 int32_t y = row * GRID_SIZE + margin_y;
 
-                // Flash effect when clearing line.
-                if ((framecount % 2) == 0)
+                // Flash effect when clearing line, 30 Hz at any frame rate.
+                float render_time = game->time +
+                                    alpha * TARGET_SECONDS_PER_FRAME;
+                if (((int32_t)(render_time * 30.f) % 2) == 0)
                 {
                     flash_color = color(0xFF, 0xFF, 0xFF, 0xFF);
                 }
@@ -701,29 +656,29 @@ void render_game(const Game_State *game, SDL_Renderer *renderer,
                     flash_color = color(0x0, 0x0, 0x0, 0x0);
                 }
                 
-                fill_rect(renderer, x, y, WIDTH * GRID_SIZE, GRID_SIZE,
+                fill_rect(renderer, x, y, SCREEN_WIDTH, GRID_SIZE,
                           flash_color);
             }
         }
     }
     else if (game->phase == GAME_PHASE_PAUSE)
     {
-        int32_t x = WIDTH * GRID_SIZE / 2;
-        int32_t y = (HEIGHT * GRID_SIZE + margin_y) / 2;
+        int32_t x = SCREEN_WIDTH / 2;
+        int32_t y = SCREEN_HEIGHT / 2;
         draw_string(renderer, font, "-PAUSED-", x, y, TEXT_ALIGN_CENTER,
                     highlight_color);
     }
     else if (game->phase == GAME_PHASE_GAMEOVER)
     {
-        int32_t x = WIDTH * GRID_SIZE / 2;
-        int32_t y = (HEIGHT * GRID_SIZE + margin_y) / 2;
+        int32_t x = SCREEN_WIDTH / 2;
+        int32_t y = SCREEN_HEIGHT / 2;
         draw_string(renderer, font, "GAME OVER", x, y, TEXT_ALIGN_CENTER,
                     highlight_color);
     }
     else if (game->phase == GAME_PHASE_START)
     {
-        int32_t x = WIDTH * GRID_SIZE / 2;
-        int32_t y = ((HEIGHT * GRID_SIZE + margin_y) / 2) - 140;
+        int32_t x = SCREEN_WIDTH / 2;
+        int32_t y = (SCREEN_HEIGHT / 2) - 140;
 
 #ifdef AUDIO
         play_hiscore = true;
@@ -764,8 +719,9 @@ void render_game(const Game_State *game, SDL_Renderer *renderer,
                     x, y + 340, TEXT_ALIGN_CENTER, gray_color);
     }
     
-    fill_rect(renderer, 0, margin_y, WIDTH * GRID_SIZE,
-              (HEIGHT - VISIBLE_HEIGHT) * GRID_SIZE,
+    fill_rect(renderer, 0, margin_y, SCREEN_WIDTH,
+              (Screen_Geometry::height - Screen_Geometry::visible_height) *
+              GRID_SIZE,
               color(0x00, 0x00, 0x00, 0x00));
     
 
@@ -792,7 +748,7 @@ void render_game(const Game_State *game, SDL_Renderer *renderer,
     {
         // Next block.
         draw_preview(renderer, game, 234, 5);
-        snprintf(buffer, sizeof(buffer), "FPS: %.4f", framespersecond);
+        snprintf(buffer, sizeof(buffer), "FPS: %.1f", framespersecond);
         draw_string(renderer, tiny_font, buffer, 175, 70, TEXT_ALIGN_LEFT,
                     gray_color);
 
@@ -803,8 +759,184 @@ void render_game(const Game_State *game, SDL_Renderer *renderer,
     }
 }
 
-int main()
+void update_frame_report()
+{
+    const char *PHASE_LABELS[FRAME_PHASE_COUNT] = {
+        "INPUT", "UPDATE", "RENDER", "PRESENT", "FRAME"
+    };
+    for (int32_t phase = 0; phase < FRAME_PHASE_COUNT; ++phase)
+    {
+        Frame_Summary summary;
+        frame_stats_summary(&frame_stats, (Frame_Phase)phase, &summary);
+        char (*cells)[16] = frame_report[phase];
+        snprintf(cells[0], sizeof(cells[0]), "%s", PHASE_LABELS[phase]);
+        snprintf(cells[1], sizeof(cells[1]), "%.1f", summary.p50_ms);
+        snprintf(cells[2], sizeof(cells[2]), "%.1f", summary.p95_ms);
+        snprintf(cells[3], sizeof(cells[3]), "%.1f", summary.p99_ms);
+        snprintf(cells[4], sizeof(cells[4]), "%.1f", summary.max_ms);
+
+        // The median frame, so a few slow frames do not hide in the FPS.
+        if (phase == FRAME_PHASE_FRAME && summary.p50_ms > 0)
+        {
+            framespersecond = 1000.f / summary.p50_ms;
+        }
+    }
+}
+
+void draw_frame_report(SDL_Renderer *renderer, const Glyph_Atlas *font)
+{
+    const char *HEADER[] = { "MS", "P50", "P95", "P99", "MAX" };
+    const int32_t COLUMN_X[] = { 10, 130, 180, 235, 290 };
+    const int32_t ROW_HEIGHT = 20;
+    int32_t y = BOARD_MARGIN_Y + 10;
+
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+    fill_rect(renderer, 0, BOARD_MARGIN_Y, SCREEN_WIDTH,
+              (FRAME_PHASE_COUNT + 1) * ROW_HEIGHT + 20,
+              color(0x00, 0x00, 0x00, 0xC0));
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+
+    Color text_color = color(0xFF, 0xFF, 0xFF, 0xFF);
+    for (int32_t row = 0; row <= FRAME_PHASE_COUNT; ++row)
+    {
+        for (int32_t column = 0; column < 5; ++column)
+        {
+            const char *text = row == 0 ? HEADER[column] :
+                                          frame_report[row - 1][column];
+            draw_string(renderer, font, text, COLUMN_X[column], y,
+                        column == 0 ? TEXT_ALIGN_LEFT : TEXT_ALIGN_RIGHT,
+                        text_color);
+        }
+        y += ROW_HEIGHT;
+    }
+}
+
+uint16_t read_keys(const uint8_t *key_states)
+{
+    uint16_t keys = 0;
+    keys |= key_states[SDL_SCANCODE_LEFT] ? INPUT_KEY_LEFT : 0;
+    keys |= key_states[SDL_SCANCODE_RIGHT] ? INPUT_KEY_RIGHT : 0;
+    keys |= key_states[SDL_SCANCODE_UP] ? INPUT_KEY_UP : 0;
+    keys |= key_states[SDL_SCANCODE_DOWN] ? INPUT_KEY_DOWN : 0;
+    keys |= key_states[SDL_SCANCODE_A] ? INPUT_KEY_A : 0;
+    keys |= key_states[SDL_SCANCODE_S] ? INPUT_KEY_S : 0;
+    keys |= key_states[SDL_SCANCODE_D] ? INPUT_KEY_D : 0;
+    keys |= key_states[SDL_SCANCODE_P] ? INPUT_KEY_P : 0;
+    keys |= key_states[SDL_SCANCODE_SPACE] ? INPUT_KEY_SPACE : 0;
+    return keys;
+}
+
+// AI games don't count towards the high score.
+void process_game_events(Game_State *game, bool update_hiscore)
+{
+    if (update_hiscore && game->score > game->hiscore &&
+        game->phase == GAME_PHASE_PLAY)
+    {
+        game->hiscore = game->score;
+#ifdef AUDIO
+        if (play_hiscore)
+        {
+            playSoundFromBank(sounds[SOUND_HISCORE], SDL_MIX_MAXVOLUME / 2);
+            play_hiscore = false;
+        }
+#endif
+    }
+
+#ifdef AUDIO
+    if (game->events & GAME_EVENT_DROP)
+    {
+        playSoundFromBank(sounds[SOUND_DROP], SDL_MIX_MAXVOLUME / 2);
+    }
+    if (game->events & GAME_EVENT_CLEAR)
+    {
+        playSoundFromBank(sounds[SOUND_CLEAR], SDL_MIX_MAXVOLUME / 2);
+    }
+    if (game->events & GAME_EVENT_GAMEOVER)
+    {
+        playSoundFromBank(sounds[SOUND_GAMEOVER], SDL_MIX_MAXVOLUME / 2);
+    }
+    if (game->events & GAME_EVENT_PAUSE)
+    {
+        playSoundFromBank(sounds[SOUND_PAUSE], SDL_MIX_MAXVOLUME / 2);
+    }
+#endif
+}
+
+int main(int argc, char **argv)
 {
+    const char *record_filename = 0;
+    const char *replay_filename = 0;
+    bool autoplay = false;
+    const char *frame_csv_filename = 0;
+#ifdef AUDIO
+    uint16_t audio_samples = AUDIO_SAMPLES_AUTO;
+    bool audio_latency = false;
+#endif
+    bool usage_error = false;
+    for (int32_t i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+        {
+            record_filename = argv[++i];
+        }
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+        {
+            replay_filename = argv[++i];
+        }
+        else if (strcmp(argv[i], "--autoplay") == 0)
+        {
+            autoplay = true;
+        }
+        else if (strcmp(argv[i], "--frame-csv") == 0 && i + 1 < argc)
+        {
+            frame_csv_filename = argv[++i];
+        }
+#ifdef AUDIO
+        else if (strcmp(argv[i], "--audio-samples") == 0 && i + 1 < argc)
+        {
+            ++i;
+            if (strcmp(argv[i], "auto") == 0)
+            {
+                audio_samples = AUDIO_SAMPLES_AUTO;
+            }
+            else
+            {
+                // SDL wants a power of 2 that fits its 16 bit field.
+                int32_t samples = atoi(argv[i]);
+                usage_error = samples < 64 || samples > 32768 ||
+                              (samples & (samples - 1)) != 0;
+                audio_samples = (uint16_t)samples;
+            }
+        }
+        else if (strcmp(argv[i], "--audio-latency") == 0)
+        {
+            audio_latency = true;
+        }
+#endif
+        else
+        {
+            usage_error = true;
+        }
+
+        if (usage_error)
+        {
+            fprintf(stderr,
+                    "usage: %s [--record FILE] [--replay FILE] [--autoplay] "
+                    "[--frame-csv FILE] [--audio-samples N|auto] "
+                    "[--audio-latency]\n",
+                    argv[0]);
+            return 5;
+        }
+    }
+
+    Replay replay = {};
+    Replay_Player replay_player = {};
+    if (replay_filename && !replay_load(&replay, replay_filename))
+    {
+        fprintf(stderr, "Failed to load replay %s\n", replay_filename);
+        return 5;
+    }
+
     if (SDL_Init(SDL_INIT_VIDEO) < 0)
     {
         return 1;
@@ -815,18 +947,10 @@ int main()
     {
         return 1; 
     }
-    initAudio();
-    drop_sound = createAudio("sounds/drop.wav", 0, SDL_MIX_MAXVOLUME / 2);
-    clear_sound = createAudio("sounds/clear.wav", 0, SDL_MIX_MAXVOLUME / 2);
-    hiscore_sound = createAudio("sounds/hiscore.wav", 0,
-                                SDL_MIX_MAXVOLUME / 2);
-    pause_sound = createAudio("sounds/pause.wav", 0, SDL_MIX_MAXVOLUME / 2);
-    gameover_sound = createAudio("sounds/gameover.wav", 0,
-                                 SDL_MIX_MAXVOLUME / 2);
+    initAudio(audio_samples, audio_latency ? 1 : 0);
+    loadSoundBank(SOUND_FILENAMES, SOUND_COUNT, sounds);
 #endif
 
-    fps_init();
-
     if (TTF_Init() < 0)
     {
         return 2;
@@ -836,8 +960,8 @@ int main()
         "Tetris v1.55",
         SDL_WINDOWPOS_UNDEFINED,
         SDL_WINDOWPOS_UNDEFINED,
-        300,
-        720,
+        SCREEN_WIDTH,
+        SCREEN_HEIGHT,
         SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN);
     SDL_Renderer *renderer = SDL_CreateRenderer(
         window,
@@ -846,37 +970,91 @@ int main()
 
     // Amiga classic.
     const char *font_name = "fonts/P0T-NOoDLE_v1.0.ttf";
-    TTF_Font *font = TTF_OpenFont(font_name, 24);
-    TTF_Font *small_font = TTF_OpenFont(font_name, 20);
-    TTF_Font *tiny_font = TTF_OpenFont(font_name, 16);
+    const int32_t font_sizes[] = { 24, 16 };
+    Glyph_Atlas fonts[ARRAY_COUNT(font_sizes)];
+    for (uint32_t i = 0; i < ARRAY_COUNT(font_sizes); ++i)
+    {
+        TTF_Font *ttf_font = TTF_OpenFont(font_name, font_sizes[i]);
+        if (!ttf_font || !create_glyph_atlas(&fonts[i], renderer, ttf_font))
+        {
+            return 3;
+        }
+        TTF_CloseFont(ttf_font);
+    }
+    text_cache_init(renderer);
+
+    if (!create_cell_atlas(&cell_atlas, renderer))
+    {
+        return 4;
+    }
+
+    board_cache_init(renderer);
+
+    const Glyph_Atlas *font = &fonts[0];
+    const Glyph_Atlas *tiny_font = &fonts[1];
 
     Game_State game = {};
     Input_State input = {};
 
-    random_next_piece(&game);
-
     game.piece.tetromino_index = 2;
     game.hiscore = read_hiscore();
 
     input.key_frame_count = 0;
     input.key_skip_count = 0;
 
+    uint16_t held_keys = 0;
+    uint64_t tick = 0;
+    bool recording = false;
+
+    Ai_Table ai_table = {};
+    Ai_Player ai_player;
+    if (autoplay)
+    {
+        ai_table_init(&ai_table, &AI_DEFAULT_TABLE_CONFIG);
+    }
+    ai_player_init(&ai_player, &AI_DEFAULT_CONFIG,
+                   autoplay ? &ai_table : 0);
+
+    game.seed = (uint32_t)SDL_GetPerformanceCounter();
+    if (replay_filename)
+    {
+        tick = replay_start(&replay_player, &replay, &game, &input);
+    }
+    float accumulator = 0;
+    uint64_t counter_frequency = SDL_GetPerformanceFrequency();
+    uint64_t last_counter = SDL_GetPerformanceCounter();
+    frame_stats_init(&frame_stats, counter_frequency, last_counter);
+
+    std::ofstream frame_csv;
+    if (frame_csv_filename)
+    {
+        frame_csv.open(frame_csv_filename);
+        frame_stats_write_csv_header(frame_csv);
+    }
+
     bool quit = false;
     while (!quit)
     {
-        fps_process();
-        game.time = SDL_GetTicks() / 1000.0f;
-    
-        if (game.score > game.hiscore && game.phase == GAME_PHASE_PLAY)
+        uint64_t counter = SDL_GetPerformanceCounter();
+        if (frame_stats_begin_frame(&frame_stats, counter))
         {
-            game.hiscore = game.score;
-#ifdef AUDIO
-            if (play_hiscore)
+            if (frame_csv.is_open())
             {
-                playSoundFromMemory(hiscore_sound, SDL_MIX_MAXVOLUME / 2);
-                play_hiscore = false;
+                frame_stats_write_csv_row(&frame_stats, frame_csv);
             }
-#endif
+            if (frame_stats.frame_count % FRAME_REPORT_INTERVAL == 0)
+            {
+                update_frame_report();
+            }
+        }
+
+        accumulator += (float)(counter - last_counter) / counter_frequency;
+        last_counter = counter;
+
+        // Drop time we cannot catch up with, the game slows down instead.
+        if (accumulator > MAX_UPDATES_PER_FRAME * TARGET_SECONDS_PER_FRAME)
+        {
+            accumulator = MAX_UPDATES_PER_FRAME * TARGET_SECONDS_PER_FRAME;
         }
 
         SDL_Event e;
@@ -886,6 +1064,20 @@ int main()
             {
                 quit = true;
             }
+            else if (e.type == SDL_KEYUP)
+            {
+                held_keys |= INPUT_KEY_RELEASED;
+            }
+            else if (e.type == SDL_KEYDOWN && !e.key.repeat &&
+                     e.key.keysym.scancode == SDL_SCANCODE_F3)
+            {
+                show_frame_stats = !show_frame_stats;
+            }
+            else if (e.type == SDL_RENDER_TARGETS_RESET)
+            {
+                text_cache_invalidate();
+                board_cache.valid = false;
+            }
         }
 
         int32_t key_count;
@@ -895,87 +1087,99 @@ int main()
         {
             quit = true;
         }
-        
-        Input_State prev_input = input;
 
-        if (e.type == SDL_KEYUP)
-        {
-            input.key_frame_count = 0;
-            input.key_skip_count = 0;
-        }
-        else
-        {
-            input.key_frame_count++;
-        }
+        // Keys are latched until the next tick so short taps between ticks
+        // are not lost.
+        held_keys |= read_keys(key_states);
+        frame_stats_mark(&frame_stats, FRAME_PHASE_INPUT,
+                         SDL_GetPerformanceCounter());
 
-        input.left = key_states[SDL_SCANCODE_LEFT];
-        input.right = key_states[SDL_SCANCODE_RIGHT];
-        input.a = key_states[SDL_SCANCODE_A];
-        input.s = key_states[SDL_SCANCODE_S];
-        input.d = key_states[SDL_SCANCODE_D];
-        input.p = key_states[SDL_SCANCODE_P];
-        input.up = key_states[SDL_SCANCODE_UP];
-        input.down = key_states[SDL_SCANCODE_DOWN];
-        input.space = key_states[SDL_SCANCODE_SPACE];
-
-        input.dleft = input.left - prev_input.left;
-        input.dright = input.right - prev_input.right;
-
-        // NES key repeat rules (16 frames threshold, 6 frames per repeat).
-        if (input.key_frame_count >= 10)
+        while (accumulator >= TARGET_SECONDS_PER_FRAME)
         {
-            if (input.key_skip_count >= 5)
+            if (replay_filename &&
+                !replay_next_keys(&replay_player, &held_keys))
             {
-                input.key_skip_count = 0;
-                input.da = input.a;
-                input.ds = input.s;
-                input.dd = input.d;
-                input.dup = input.up;
-                input.ddown = input.down;
-                
+                held_keys = 0;
             }
-            else
+            else if (autoplay)
             {
-                input.key_skip_count++;
-                input.da = 0;
-                input.ds = 0;
-                input.dd = 0;
-                input.dup = 0;
-                input.ddown = 0;
+                held_keys = ai_player_next_keys(&ai_player, &game);
             }
+
+            bool starting = game.phase == GAME_PHASE_START;
+            uint32_t seed = game.seed;
+
+            update_input(&input, held_keys);
+            update_game(&game, &input, get_tick_time(tick));
+            process_game_events(&game, !autoplay);
+
+            if (record_filename)
+            {
+                if (recording)
+                {
+                    replay_record(&replay, held_keys);
+                    if (game.phase == GAME_PHASE_GAMEOVER)
+                    {
+                        replay_save(&replay, record_filename);
+                        recording = false;
+                    }
+                }
+                else if (starting && game.phase == GAME_PHASE_PLAY)
+                {
+                    replay_begin(&replay, &game, &input, seed,
+                                 (uint32_t)tick);
+                    recording = true;
+                }
+            }
+
+            held_keys = read_keys(key_states);
+            accumulator -= TARGET_SECONDS_PER_FRAME;
+            ++tick;
         }
-        else
-        {
-            input.da = input.a - prev_input.a;
-            input.ds = input.s - prev_input.s;
-            input.dd = input.d - prev_input.d;
-            input.dup = input.up - prev_input.up;
-            input.ddown = input.down - prev_input.down;
-        }
+        frame_stats_mark(&frame_stats, FRAME_PHASE_UPDATE,
+                         SDL_GetPerformanceCounter());
+
+        board_cache_sync(renderer, &game);
 
-        input.dp = input.p - prev_input.p;
-        input.dspace = input.space - prev_input.space;
-        
         SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
         SDL_RenderClear(renderer);
 
-        update_game(&game, &input);
-        render_game(&game, renderer, font, small_font, tiny_font);
+        render_game(&game, accumulator / TARGET_SECONDS_PER_FRAME,
+                    renderer, font, tiny_font);
+        if (show_frame_stats)
+        {
+            draw_frame_report(renderer, tiny_font);
+        }
+        frame_stats_mark(&frame_stats, FRAME_PHASE_RENDER,
+                         SDL_GetPerformanceCounter());
 
         SDL_RenderPresent(renderer);
+        frame_stats_mark(&frame_stats, FRAME_PHASE_PRESENT,
+                         SDL_GetPerformanceCounter());
+    }
+
+    if (recording)
+    {
+        replay_save(&replay, record_filename);
     }
 
-    write_hiscore(game.hiscore);
+    if (!replay_filename && !autoplay)
+    {
+        write_hiscore(game.hiscore);
+    }
 
 #ifdef AUDIO
-    freeAudio(drop_sound);
-    freeAudio(clear_sound);
-    freeAudio(hiscore_sound);
-    freeAudio(pause_sound);
-    freeAudio(gameover_sound);
+    endAudio();
 #endif
 
-    TTF_CloseFont(font);
+    ai_table_free(&ai_table);
+    text_cache_free();
+    destroy_cell_atlas(&cell_atlas);
+    board_cache_free();
+    for (uint32_t i = 0; i < ARRAY_COUNT(fonts); ++i)
+    {
+        destroy_glyph_atlas(&fonts[i]);
+    }
     SDL_DestroyRenderer(renderer);
     SDL_Quit();
 
@@ -1,3 +1,9 @@
+#ifndef TETRIS_H
+#define TETRIS_H
+
+#include <cstdint>
+#include <type_traits>
+
 #define WIDTH 10
 #define HEIGHT 22
 #define VISIBLE_HEIGHT 20
@@ -6,13 +12,6 @@
 
 #define ARRAY_COUNT(x) (sizeof(x) / sizeof((x)[0]))
 
-// FPS related.
-#define FRAME_VALUES 10
-uint32_t frametimes[FRAME_VALUES];
-uint32_t frametimelast;
-uint32_t framecount;
-float framespersecond;
-
 // NES inspired.
 const uint8_t FRAMES_PER_DROP[] = {
     48,
@@ -49,61 +48,89 @@ const uint8_t FRAMES_PER_DROP[] = {
 
 const float TARGET_SECONDS_PER_FRAME = 1.f / 60.f;
 
+// Board size as a compile time parameter of the core, so each supported size
+// gets its own code with constant bounds. Bit N of a Row is column N, the
+// narrowest type that fits is used. Sets of rows are 64 bit masks, bit N is
+// row N. The top two rows are hidden and pieces spawn there.
+template <int32_t Width, int32_t Height>
+struct Board_Geometry
+{
+    static_assert(Width <= 32, "Rows are at most 32 bits wide.");
+    static_assert(Height <= 64, "Row sets are 64 bit masks.");
+
+    typedef typename std::conditional<Width <= 16, uint16_t, uint32_t>::type
+        Row;
+
+    static constexpr int32_t width = Width;
+    static constexpr int32_t height = Height;
+    static constexpr int32_t visible_height = Height - 2;
+    static constexpr Row full_row = (Row)((1ull << Width) - 1);
+    static constexpr uint64_t all_rows = Height == 64 ? ~0ull :
+                                         (1ull << Height) - 1;
+};
+
+typedef Board_Geometry<WIDTH, HEIGHT> Default_Geometry;
+// Stress testing variant.
+typedef Board_Geometry<20, 44> Wide_Geometry;
+
+static_assert(Default_Geometry::visible_height == VISIBLE_HEIGHT,
+              "Two hidden rows.");
+
 struct Tetromino
 {
     const uint8_t *data;
     const int32_t side;
 };
 
-Tetromino tetromino(const uint8_t *data, int32_t side)
+constexpr Tetromino tetromino(const uint8_t *data, int32_t side)
 {
     return { data, side };
 }
 
-const uint8_t TETROMINO_1[] = {
+constexpr uint8_t TETROMINO_1[] = {
     0, 0, 0, 0,
     1, 1, 1, 1,
     0, 0, 0, 0,
     0, 0, 0, 0
 };
 
-const uint8_t TETROMINO_2[] = {
+constexpr uint8_t TETROMINO_2[] = {
     2, 2,
     2, 2
 };
 
-const uint8_t TETROMINO_3[] = {
+constexpr uint8_t TETROMINO_3[] = {
     0, 0, 0,
     3, 3, 3,
     0, 3, 0
 };
 
-const uint8_t TETROMINO_4[] = {
+constexpr uint8_t TETROMINO_4[] = {
     0, 4, 4,
     4, 4, 0,
     0, 0, 0
 };
 
-const uint8_t TETROMINO_5[] = {
+constexpr uint8_t TETROMINO_5[] = {
     5, 5, 0,
     0, 5, 5,
     0, 0, 0
 };
 
-const uint8_t TETROMINO_6[] = {
+constexpr uint8_t TETROMINO_6[] = {
     6, 0, 0,
     6, 6, 6,
     0, 0, 0
 };
 
-const uint8_t TETROMINO_7[] = {
+constexpr uint8_t TETROMINO_7[] = {
     0, 0, 7,
     7, 7, 7,
     0, 0, 0
 };
 
 
-const Tetromino TETROMINOS[] = {
+constexpr Tetromino TETROMINOS[] = {
     tetromino(TETROMINO_1, 4),
     tetromino(TETROMINO_2, 2),
     tetromino(TETROMINO_3, 3),
@@ -113,6 +140,109 @@ const Tetromino TETROMINOS[] = {
     tetromino(TETROMINO_7, 3),
 };
 
+constexpr uint8_t tetromino_get(const Tetromino *tetromino, int32_t row,
+                                int32_t col, int32_t rotation)
+{
+    int32_t side = tetromino->side;
+    switch (rotation)
+    {
+    case 0:
+        return tetromino->data[row * side + col];
+    case 1:
+        return tetromino->data[(side - col - 1) * side + row];
+    case 2:
+        return tetromino->data[(side - row - 1) * side + (side - col - 1)];
+    case 3:
+        return tetromino->data[col * side + (side - row - 1)];
+    }
+    return 0;
+}
+
+struct Piece_Cell
+{
+    int32_t row;
+    int32_t col;
+};
+
+// One rotated tetromino, precomputed so consumers never scan the 4x4 square.
+// Row masks have bit 0 at column min_col.
+struct Piece_Shape
+{
+    uint8_t value;
+    int32_t cell_count;
+    Piece_Cell cells[4];
+    int32_t min_row;
+    int32_t max_row;
+    int32_t min_col;
+    int32_t max_col;
+    uint16_t rows[4];
+    // Lowest row of each column from min_col, the side the piece lands on.
+    int32_t bottom_rows[4];
+};
+
+struct Piece_Shape_Table
+{
+    Piece_Shape shapes[ARRAY_COUNT(TETROMINOS)][4];
+};
+
+constexpr Piece_Shape make_piece_shape(const Tetromino *tetromino,
+                                       int32_t rotation)
+{
+    Piece_Shape shape = {};
+    shape.min_row = tetromino->side;
+    shape.min_col = tetromino->side;
+    shape.max_row = -1;
+    shape.max_col = -1;
+    for (int32_t row = 0; row < tetromino->side; ++row)
+    {
+        for (int32_t col = 0; col < tetromino->side; ++col)
+        {
+            uint8_t value = tetromino_get(tetromino, row, col, rotation);
+            if (value)
+            {
+                shape.value = value;
+                shape.cells[shape.cell_count].row = row;
+                shape.cells[shape.cell_count].col = col;
+                ++shape.cell_count;
+                shape.min_row = row < shape.min_row ? row : shape.min_row;
+                shape.max_row = row > shape.max_row ? row : shape.max_row;
+                shape.min_col = col < shape.min_col ? col : shape.min_col;
+                shape.max_col = col > shape.max_col ? col : shape.max_col;
+            }
+        }
+    }
+    for (int32_t i = 0; i < shape.cell_count; ++i)
+    {
+        const Piece_Cell &cell = shape.cells[i];
+        shape.rows[cell.row] |= (uint16_t)(1 << (cell.col - shape.min_col));
+        int32_t &bottom = shape.bottom_rows[cell.col - shape.min_col];
+        bottom = cell.row > bottom ? cell.row : bottom;
+    }
+    return shape;
+}
+
+constexpr Piece_Shape_Table make_piece_shape_table()
+{
+    Piece_Shape_Table table = {};
+    for (uint32_t index = 0; index < ARRAY_COUNT(TETROMINOS); ++index)
+    {
+        for (int32_t rotation = 0; rotation < 4; ++rotation)
+        {
+            table.shapes[index][rotation] = make_piece_shape(
+                                                TETROMINOS + index, rotation);
+        }
+    }
+    return table;
+}
+
+constexpr Piece_Shape_Table PIECE_SHAPES = make_piece_shape_table();
+
+constexpr const Piece_Shape *piece_shape(uint8_t tetromino_index,
+                                         int32_t rotation)
+{
+    return &PIECE_SHAPES.shapes[tetromino_index][rotation];
+}
+
 enum Game_Phase
 {
     GAME_PHASE_START,
@@ -130,10 +260,30 @@ struct Piece_State
     int32_t rotation;
 };
 
-struct Game_State
+struct Random_State
 {
-    uint8_t board[WIDTH * HEIGHT];
-    uint8_t lines[HEIGHT];
+    uint64_t state;
+    uint64_t inc;
+};
+
+template <typename G>
+struct Basic_Game_State
+{
+    typedef G Geometry;
+
+    uint8_t board[G::width * G::height];
+    typename G::Row bitboard[G::height];
+    // Kept up to date by merge_piece and clear_lines. A column's height is
+    // height minus the row of its top cell, 0 when empty. Holes are empty
+    // cells below the top of their column.
+    uint8_t column_heights[G::width];
+    uint8_t row_fills[G::height];
+    int32_t hole_count;
+    // Rows changed since the renderer last synced, cleared by the caller.
+    uint64_t dirty_rows;
+    // Rows a piece locked into during the current update_game call.
+    uint64_t locked_rows;
+    uint8_t lines[G::height];
     int32_t pending_line_count;
 
     uint8_t tetromino_next;
@@ -141,18 +291,28 @@ struct Game_State
     Piece_State piece;
 
     Game_Phase phase;
+
+    // Seeds the piece sequence of the next start_game.
+    uint32_t seed;
+    Random_State random;
     
     int32_t start_level;
     int32_t level;
     int32_t line_count;
     int32_t score;
     int32_t hiscore;
+    int32_t piece_count;
+
+    uint32_t events;
     
     float next_drop_time;
     float highlight_end_time;
     float time;
 };
 
+typedef Basic_Game_State<Default_Geometry> Game_State;
+typedef Basic_Game_State<Wide_Geometry> Wide_Game_State;
+
 struct Input_State
 {
     uint8_t left;
@@ -180,9 +340,114 @@ struct Input_State
     int8_t dspace;
 };
 
-enum Text_Align
+// Raw key state for one tick, see update_input.
+enum Input_Key
 {
-    TEXT_ALIGN_LEFT,
-    TEXT_ALIGN_CENTER,
-    TEXT_ALIGN_RIGHT
+    INPUT_KEY_LEFT = 1 << 0,
+    INPUT_KEY_RIGHT = 1 << 1,
+    INPUT_KEY_UP = 1 << 2,
+    INPUT_KEY_DOWN = 1 << 3,
+    INPUT_KEY_A = 1 << 4,
+    INPUT_KEY_S = 1 << 5,
+    INPUT_KEY_D = 1 << 6,
+    INPUT_KEY_P = 1 << 7,
+    INPUT_KEY_SPACE = 1 << 8,
+
+    // A key went up since the previous tick, restarts key repeat.
+    INPUT_KEY_RELEASED = 1 << 15
+};
+
+// Sounds and other side effects are reported to the caller, the core never
+// talks to SDL.
+enum Game_Event
+{
+    GAME_EVENT_DROP = 1 << 0,
+    GAME_EVENT_CLEAR = 1 << 1,
+    GAME_EVENT_PAUSE = 1 << 2,
+    GAME_EVENT_GAMEOVER = 1 << 3
 };
+
+uint8_t matrix_get(const uint8_t *values, int32_t width, int32_t row,
+                   int32_t col);
+void matrix_set(uint8_t *values, int32_t width, int32_t row, int32_t col,
+                uint8_t value);
+// Everything that depends on the board size is a template over the geometry,
+// defined in tetris_core.cc and instantiated there for the geometries listed
+// at the end of this file. Functions that cannot deduce it from their
+// arguments default to Default_Geometry.
+template <typename G = Default_Geometry>
+uint8_t check_row_filled(const typename G::Row *bitboard, int32_t row);
+template <typename G = Default_Geometry>
+uint8_t check_row_empty(const typename G::Row *bitboard, int32_t row);
+// Marks which of the rows in row_mask are full, all other rows are cleared.
+int32_t find_lines(const uint8_t *row_fills, int32_t width, int32_t height,
+                   uint64_t row_mask, uint8_t *lines_out);
+// Removes the rows marked in game->lines.
+template <typename G>
+void clear_lines(Basic_Game_State<G> *game);
+template <typename G>
+void clear_board(Basic_Game_State<G> *game);
+template <typename G = Default_Geometry>
+bool check_piece_valid(const Piece_State *piece,
+                       const typename G::Row *bitboard);
+template <typename G>
+void merge_piece(Basic_Game_State<G> *game);
+// Rows piece can fall before it lands. Constant time from the column heights
+// unless the piece is already below the top of a column it covers.
+template <typename G>
+int32_t get_drop_distance(const Basic_Game_State<G> *game,
+                          const Piece_State *piece);
+float get_time_to_next_drop(int32_t level);
+void random_seed(Random_State *random, uint64_t seed);
+uint32_t random_next(Random_State *random);
+// Uniform in [min, max).
+int32_t random_int(Random_State *random, int32_t min, int32_t max);
+template <typename G>
+void random_next_piece(Basic_Game_State<G> *game);
+template <typename G>
+void spawn_piece(Basic_Game_State<G> *game);
+template <typename G>
+bool soft_drop(Basic_Game_State<G> *game);
+int32_t compute_score(int32_t level, int32_t line_count);
+int32_t get_lines_for_next_level(int32_t start_level, int32_t level);
+
+// Starts a new game at start_level with pieces drawn from seed.
+template <typename G>
+void start_game(Basic_Game_State<G> *game);
+
+// Game clock of a fixed 60 Hz tick.
+float get_tick_time(uint64_t tick);
+
+// Raw key mask currently held in input, without INPUT_KEY_RELEASED.
+uint16_t get_input_keys(const Input_State *input);
+
+// Derives the pressed/repeat deltas for one tick from the raw keys.
+void update_input(Input_State *input, uint16_t keys);
+
+// Advances the game by one step. The caller owns the clock, time is in
+// seconds and must not go backwards. Resets events and locked_rows.
+template <typename G>
+void update_game(Basic_Game_State<G> *game, const Input_State *input,
+                 float time);
+
+#define TETRIS_CORE_INSTANTIATE(prefix, G)                                  \
+    prefix uint8_t check_row_filled<G>(const G::Row *bitboard, int32_t row); \
+    prefix uint8_t check_row_empty<G>(const G::Row *bitboard, int32_t row);  \
+    prefix void clear_lines(Basic_Game_State<G> *game);                     \
+    prefix void clear_board(Basic_Game_State<G> *game);                     \
+    prefix bool check_piece_valid<G>(const Piece_State *piece,              \
+                                     const G::Row *bitboard);               \
+    prefix void merge_piece(Basic_Game_State<G> *game);                     \
+    prefix int32_t get_drop_distance(const Basic_Game_State<G> *game,       \
+                                     const Piece_State *piece);             \
+    prefix void random_next_piece(Basic_Game_State<G> *game);               \
+    prefix void spawn_piece(Basic_Game_State<G> *game);                     \
+    prefix bool soft_drop(Basic_Game_State<G> *game);                       \
+    prefix void start_game(Basic_Game_State<G> *game);                      \
+    prefix void update_game(Basic_Game_State<G> *game,                      \
+                            const Input_State *input, float time);
+
+TETRIS_CORE_INSTANTIATE(extern template, Default_Geometry)
+TETRIS_CORE_INSTANTIATE(extern template, Wide_Geometry)
+
+#endif
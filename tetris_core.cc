@@ -0,0 +1,597 @@
+#include <cstdint>
+#include <cstring>
+
+#include "tetris.h"
+#include "row_kernels.h"
+
+uint8_t matrix_get(const uint8_t *values, int32_t width, int32_t row,
+                   int32_t col)
+{
+    int32_t index = row * width + col;
+    return values[index];
+}
+
+void matrix_set(uint8_t *values, int32_t width, int32_t row, int32_t col,
+                uint8_t value)
+{
+    int32_t index = row * width + col;
+    values[index] = value;
+}
+
+template <typename G>
+uint8_t check_row_filled(const typename G::Row *bitboard, int32_t row)
+{
+    return bitboard[row] == G::full_row;
+}
+
+template <typename G>
+uint8_t check_row_empty(const typename G::Row *bitboard, int32_t row)
+{
+    return bitboard[row] == 0;
+}
+
+int32_t find_lines(const uint8_t *row_fills, int32_t width, int32_t height,
+                   uint64_t row_mask, uint8_t *lines_out)
+{
+    memset(lines_out, 0, height);
+
+    uint64_t full_rows = match_rows(row_fills, height, (uint8_t)width) &
+                         row_mask;
+    int32_t count = 0;
+    for (int32_t row = 0; full_rows; ++row, full_rows >>= 1)
+    {
+        if (full_rows & 1)
+        {
+            lines_out[row] = 1;
+            ++count;
+        }
+    }
+    return count;
+}
+
+template <typename G>
+static void update_column_heights(Basic_Game_State<G> *game)
+{
+    memset(game->column_heights, 0, sizeof(game->column_heights));
+
+    int32_t height_sum = 0;
+    int32_t fill_sum = 0;
+    uint32_t seen = 0;
+    for (int32_t row = 0; row < G::height; ++row)
+    {
+        uint32_t tops = game->bitboard[row] & ~seen;
+        for (int32_t col = 0; tops; ++col, tops >>= 1)
+        {
+            if (tops & 1)
+            {
+                game->column_heights[col] = (uint8_t)(G::height - row);
+                height_sum += G::height - row;
+            }
+        }
+        seen |= game->bitboard[row];
+        fill_sum += game->row_fills[row];
+    }
+    game->hole_count = height_sum - fill_sum;
+}
+
+template <typename G>
+void clear_lines(Basic_Game_State<G> *game)
+{
+    uint64_t line_rows = match_rows(game->lines, G::height, 1);
+    compact_rows(game->board, G::width, G::height, line_rows);
+    compact_rows(game->bitboard, sizeof(game->bitboard[0]), G::height,
+                 line_rows);
+    compact_rows(game->row_fills, 1, G::height, line_rows);
+    update_column_heights(game);
+}
+
+template <typename G>
+void clear_board(Basic_Game_State<G> *game)
+{
+    memset(game->board, 0, sizeof(game->board));
+    memset(game->bitboard, 0, sizeof(game->bitboard));
+    memset(game->column_heights, 0, sizeof(game->column_heights));
+    memset(game->row_fills, 0, sizeof(game->row_fills));
+    game->hole_count = 0;
+    game->dirty_rows = G::all_rows;
+}
+
+template <typename G>
+bool check_piece_valid(const Piece_State *piece,
+                       const typename G::Row *bitboard)
+{
+    const Piece_Shape *shape = piece_shape(piece->tetromino_index,
+                                           piece->rotation);
+
+    int32_t shift = piece->offset_col + shape->min_col;
+    if (shift < 0 || piece->offset_col + shape->max_col >= G::width)
+    {
+        return false;
+    }
+    if (piece->offset_row + shape->min_row < 0 ||
+        piece->offset_row + shape->max_row >= G::height)
+    {
+        return false;
+    }
+
+    for (int32_t row = shape->min_row; row <= shape->max_row; ++row)
+    {
+        typename G::Row mask = (typename G::Row)shape->rows[row] << shift;
+        if (bitboard[piece->offset_row + row] & mask)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename G>
+void merge_piece(Basic_Game_State<G> *game)
+{
+    const Piece_Shape *shape = piece_shape(game->piece.tetromino_index,
+                                           game->piece.rotation);
+    for (int32_t i = 0; i < shape->cell_count; ++i)
+    {
+        int32_t board_row = game->piece.offset_row + shape->cells[i].row;
+        int32_t board_col = game->piece.offset_col + shape->cells[i].col;
+        matrix_set(game->board, G::width, board_row, board_col,
+                   shape->value);
+        typename G::Row bit = (typename G::Row)(1u << board_col);
+        bool overlap = (game->bitboard[board_row] & bit) != 0;
+        game->bitboard[board_row] |= bit;
+        game->dirty_rows |= 1ull << board_row;
+        game->locked_rows |= 1ull << board_row;
+
+        // Two locks in one tick can spawn the second piece into the stack
+        // of a game that is about to end.
+        if (overlap)
+        {
+            continue;
+        }
+
+        // The cell fills a hole or raises its column, leaving a new hole for
+        // every row it skipped.
+        ++game->row_fills[board_row];
+        int32_t height = G::height - board_row;
+        int32_t old_height = game->column_heights[board_col];
+        if (height > old_height)
+        {
+            game->column_heights[board_col] = (uint8_t)height;
+            game->hole_count += height - old_height;
+        }
+        --game->hole_count;
+    }
+    ++game->piece_count;
+}
+
+template <typename G>
+int32_t get_drop_distance(const Basic_Game_State<G> *game,
+                          const Piece_State *piece)
+{
+    const Piece_Shape *shape = piece_shape(piece->tetromino_index,
+                                           piece->rotation);
+    int32_t distance = G::height;
+    for (int32_t col = shape->min_col; col <= shape->max_col; ++col)
+    {
+        int32_t bottom = piece->offset_row +
+                         shape->bottom_rows[col - shape->min_col];
+        int32_t top = G::height -
+                      game->column_heights[piece->offset_col + col];
+        if (bottom >= top)
+        {
+            // Tucked under an overhang, the heights say nothing about the
+            // gap below, so walk down the bitboard instead.
+            Piece_State dropped = *piece;
+            do
+            {
+                ++dropped.offset_row;
+            }
+            while (check_piece_valid<G>(&dropped, game->bitboard));
+            return dropped.offset_row - 1 - piece->offset_row;
+        }
+        if (top - 1 - bottom < distance)
+        {
+            distance = top - 1 - bottom;
+        }
+    }
+    return distance;
+}
+
+// PCG32 (XSH RR), see pcg-random.org.
+void random_seed(Random_State *random, uint64_t seed)
+{
+    random->state = 0;
+    random->inc = (seed << 1) | 1;
+    random_next(random);
+    random->state += seed;
+    random_next(random);
+}
+
+uint32_t random_next(Random_State *random)
+{
+    uint64_t state = random->state;
+    random->state = state * 6364136223846793005ull + random->inc;
+    uint32_t xorshifted = (uint32_t)(((state >> 18) ^ state) >> 27);
+    uint32_t rot = (uint32_t)(state >> 59);
+    return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+}
+
+// Unbiased, Lemire's multiply and reject.
+int32_t random_int(Random_State *random, int32_t min, int32_t max)
+{
+    uint32_t range = (uint32_t)(max - min);
+    uint64_t product = (uint64_t)random_next(random) * range;
+    uint32_t low = (uint32_t)product;
+    if (low < range)
+    {
+        uint32_t threshold = (0u - range) % range;
+        while (low < threshold)
+        {
+            product = (uint64_t)random_next(random) * range;
+            low = (uint32_t)product;
+        }
+    }
+    return min + (int32_t)(product >> 32);
+}
+
+float get_time_to_next_drop(int32_t level)
+{
+    if (level > 29)
+    {
+        level = 29;
+    }
+    return FRAMES_PER_DROP[level] * TARGET_SECONDS_PER_FRAME;
+}
+
+template <typename G>
+void random_next_piece(Basic_Game_State<G> *game)
+{
+    game->tetromino_next = (uint8_t)random_int(&game->random, 0,
+                                               ARRAY_COUNT(TETROMINOS));
+}
+
+template <typename G>
+void spawn_piece(Basic_Game_State<G> *game)
+{
+    game->piece = {};
+    game->piece.tetromino_index = game->tetromino_next;
+    game->piece.offset_col = G::width / 2;
+    game->next_drop_time = game->time + get_time_to_next_drop(game->level);
+}
+
+
+template <typename G>
+bool soft_drop(Basic_Game_State<G> *game)
+{
+    if (get_drop_distance(game, &game->piece) == 0)
+    {
+        merge_piece(game);
+        spawn_piece(game);
+        random_next_piece(game);
+
+        game->events |= GAME_EVENT_DROP;
+
+        return false;
+    }
+    ++game->piece.offset_row;
+    game->next_drop_time = game->time + get_time_to_next_drop(game->level);
+    return true;
+}
+
+int32_t compute_score(int32_t level, int32_t line_count)
+{
+    switch (line_count)
+    {
+    case 1:
+        return 40 * (level + 1);
+    case 2:
+        return 100 * (level + 1);
+    case 3:
+        return 300 * (level + 1);
+    case 4:
+        return 1200 * (level + 1);
+    }
+    return 0;
+}
+
+int32_t min(int32_t x, int32_t y)
+{
+    return x < y ? x : y;
+}
+int32_t max(int32_t x, int32_t y)
+{
+    return x > y ? x : y;
+}
+
+int32_t get_lines_for_next_level(int32_t start_level, int32_t level)
+{
+    int32_t first_level_up_limit = min(
+        (start_level * 10 + 10),
+        max(100, (start_level * 10 - 50)));
+    if (level == start_level)
+    {
+        return first_level_up_limit;
+    }
+    int32_t diff = level - start_level;
+    return first_level_up_limit + diff * 10;
+}
+
+template <typename G>
+void start_game(Basic_Game_State<G> *game)
+{
+    random_seed(&game->random, game->seed);
+    // Successive games get different pieces but stay reproducible.
+    game->seed = game->seed * 747796405u + 2891336453u;
+
+    clear_board(game);
+    game->level = game->start_level;
+    game->line_count = 0;
+    game->score = 0;
+    game->piece_count = 0;
+    random_next_piece(game);
+    spawn_piece(game);
+    random_next_piece(game);
+    game->phase = GAME_PHASE_PLAY;
+}
+
+template <typename G>
+static void update_game_start(Basic_Game_State<G> *game,
+                              const Input_State *input)
+{
+    if (input->dup > 0)
+    {
+        ++game->start_level;
+    }
+
+    if (input->ddown > 0 && game->start_level > 0)
+    {
+        --game->start_level;
+    }
+    
+    if (input->dspace > 0)
+    {
+        start_game(game);
+    }
+}
+
+template <typename G>
+static void update_game_pause(Basic_Game_State<G> *game,
+                              const Input_State *input)
+{
+    if (input->dp > 0)
+    {
+        game->phase = GAME_PHASE_PLAY;
+        game->events |= GAME_EVENT_PAUSE;
+    }
+}
+
+template <typename G>
+static void update_game_gameover(Basic_Game_State<G> *game,
+                                 const Input_State *input)
+{
+    if (input->dspace > 0)
+    {
+        game->phase = GAME_PHASE_START;
+        clear_board(game);
+    }
+}
+
+template <typename G>
+static void update_game_line(Basic_Game_State<G> *game)
+{
+    if (game->time >= game->highlight_end_time)
+    {
+        clear_lines(game);
+
+        // Everything above the lowest cleared line moved down.
+        for (int32_t row = G::height - 1; row >= 0; --row)
+        {
+            if (game->lines[row])
+            {
+                game->dirty_rows |= G::all_rows >> (G::height - 1 - row);
+                break;
+            }
+        }
+        game->line_count += game->pending_line_count;
+        game->score += compute_score(game->level, game->pending_line_count);
+
+        int32_t lines_for_next_level = get_lines_for_next_level(
+                                                            game->start_level,
+                                                            game->level);
+        if (game->line_count >= lines_for_next_level)
+        {
+            ++game->level;
+        }
+        
+        game->phase = GAME_PHASE_PLAY;
+    }
+}
+
+template <typename G>
+static void update_game_play(Basic_Game_State<G> *game,
+                             const Input_State *input)
+{
+    Piece_State piece = game->piece;
+    if (input->da > 0)
+    {
+        --piece.offset_col;
+    }
+    if (input->dd > 0)
+    {
+        ++piece.offset_col;
+    }
+    if (input->dright > 0)
+    {
+        piece.rotation = (piece.rotation + 1) % 4;
+    }
+
+    if (input->dleft > 0)
+    {
+        piece.rotation = (piece.rotation + 3) % 4;
+    }
+
+    if (check_piece_valid<G>(&piece, game->bitboard))
+    {
+        game->piece = piece;
+    }
+
+    if (input->ds > 0 || input->ddown > 0)
+    {
+        soft_drop(game);
+    }
+
+    if (input->dspace > 0)
+    {
+        game->piece.offset_row += get_drop_distance(game, &game->piece);
+        soft_drop(game);
+    }
+    
+    while (game->time >= game->next_drop_time)
+    {
+        soft_drop(game);
+    }
+
+    // Lines and the game over row only change when a piece locks. Cleared
+    // lines shift rows down but cannot reach the game over row, as anything
+    // above it would already have ended the game.
+    if (game->locked_rows)
+    {
+        game->pending_line_count = find_lines(game->row_fills, G::width,
+                                              G::height, game->locked_rows,
+                                              game->lines);
+        if (game->pending_line_count > 0)
+        {
+            game->events |= GAME_EVENT_CLEAR;
+            game->phase = GAME_PHASE_LINE;
+            game->highlight_end_time = game->time + 0.5f;
+        }
+
+        int32_t game_over_row = G::height - G::visible_height;
+        if (!check_row_empty<G>(game->bitboard, game_over_row))
+        {
+            game->phase = GAME_PHASE_GAMEOVER;
+            game->events |= GAME_EVENT_GAMEOVER;
+        }
+    }
+
+    if (input->dp > 0)
+    {
+        game->phase = GAME_PHASE_PAUSE;
+        game->events |= GAME_EVENT_PAUSE;
+    }
+
+}
+
+float get_tick_time(uint64_t tick)
+{
+    return tick * TARGET_SECONDS_PER_FRAME;
+}
+
+uint16_t get_input_keys(const Input_State *input)
+{
+    uint16_t keys = 0;
+    keys |= input->left ? INPUT_KEY_LEFT : 0;
+    keys |= input->right ? INPUT_KEY_RIGHT : 0;
+    keys |= input->up ? INPUT_KEY_UP : 0;
+    keys |= input->down ? INPUT_KEY_DOWN : 0;
+    keys |= input->a ? INPUT_KEY_A : 0;
+    keys |= input->s ? INPUT_KEY_S : 0;
+    keys |= input->d ? INPUT_KEY_D : 0;
+    keys |= input->p ? INPUT_KEY_P : 0;
+    keys |= input->space ? INPUT_KEY_SPACE : 0;
+    return keys;
+}
+
+void update_input(Input_State *input, uint16_t keys)
+{
+    Input_State prev_input = *input;
+
+    if (keys & INPUT_KEY_RELEASED)
+    {
+        input->key_frame_count = 0;
+        input->key_skip_count = 0;
+    }
+    else
+    {
+        input->key_frame_count++;
+    }
+
+    input->left = (keys & INPUT_KEY_LEFT) != 0;
+    input->right = (keys & INPUT_KEY_RIGHT) != 0;
+    input->a = (keys & INPUT_KEY_A) != 0;
+    input->s = (keys & INPUT_KEY_S) != 0;
+    input->d = (keys & INPUT_KEY_D) != 0;
+    input->p = (keys & INPUT_KEY_P) != 0;
+    input->up = (keys & INPUT_KEY_UP) != 0;
+    input->down = (keys & INPUT_KEY_DOWN) != 0;
+    input->space = (keys & INPUT_KEY_SPACE) != 0;
+
+    input->dleft = input->left - prev_input.left;
+    input->dright = input->right - prev_input.right;
+
+    // Keys repeat once held for 10 ticks, firing after every 5 skipped ticks.
+    if (input->key_frame_count >= 10)
+    {
+        if (input->key_skip_count >= 5)
+        {
+            input->key_skip_count = 0;
+            input->da = input->a;
+            input->ds = input->s;
+            input->dd = input->d;
+            input->dup = input->up;
+            input->ddown = input->down;
+            
+        }
+        else
+        {
+            input->key_skip_count++;
+            input->da = 0;
+            input->ds = 0;
+            input->dd = 0;
+            input->dup = 0;
+            input->ddown = 0;
+        }
+    }
+    else
+    {
+        input->da = input->a - prev_input.a;
+        input->ds = input->s - prev_input.s;
+        input->dd = input->d - prev_input.d;
+        input->dup = input->up - prev_input.up;
+        input->ddown = input->down - prev_input.down;
+    }
+
+    input->dp = input->p - prev_input.p;
+    input->dspace = input->space - prev_input.space;
+}
+
+template <typename G>
+void update_game(Basic_Game_State<G> *game, const Input_State *input,
+                 float time)
+{
+    game->time = time;
+    game->events = 0;
+    game->locked_rows = 0;
+
+    switch(game->phase)
+    {
+    case GAME_PHASE_START:
+        update_game_start(game, input);
+        break;
+    case GAME_PHASE_PLAY:
+        update_game_play(game, input);
+        break;
+    case GAME_PHASE_LINE:
+        update_game_line(game);
+        break;
+    case GAME_PHASE_PAUSE:
+        update_game_pause(game, input);
+        break;
+    case GAME_PHASE_GAMEOVER:
+        update_game_gameover(game, input);
+        break;
+    }
+}
+
+TETRIS_CORE_INSTANTIATE(template, Default_Geometry)
+TETRIS_CORE_INSTANTIATE(template, Wide_Geometry)